@@ -0,0 +1,60 @@
+#include "../SpaceCadetsWeek2/lang.hpp"
+#include "../SpaceCadetsWeek2/transpiler.hpp"
+#include <fstream>
+#include <iostream>
+
+bbones::Parser CreateParser()
+{
+	return bbones::Parser::Builder()
+		.AddMapping("init", new bbones::InitStatement{})
+		.AddMapping("incr", new bbones::IncrementStatement{})
+		.AddMapping("decr", new bbones::DecrementStatement{})
+		.AddMapping("clear", new bbones::ClearStatement{})
+		.AddMapping("while", new bbones::WhileStatement{})
+		.AddMapping("copy", new bbones::CopyStatement{})
+		.AddMapping("end", new bbones::EndStatement{})
+		.AddMapping("if", new bbones::IfStatement{})
+		.AddMapping("elif", new bbones::NoopStatement{})
+		.AddMapping("else", new bbones::NoopStatement{})
+		.AddMapping("print", new bbones::PrintStatement{})
+		.AddMapping("add", new bbones::AddStatement{})
+		.AddMapping("sub", new bbones::SubStatement{})
+		.AddMapping("mul", new bbones::MulStatement{})
+		.AddMapping("div", new bbones::DivStatement{})
+		.AddMapping("mod", new bbones::ModStatement{})
+		.AddMapping("set", new bbones::SetStatement{})
+		.AddMapping("function", new bbones::FunctionDefinitionStatement{})
+		.Finish();
+}
+
+std::string GetFilePathFromUser()
+{
+	std::string result{};
+	std::cout << "Enter the file path of a BareBones program: ";
+	std::getline(std::cin, result);
+	return result;
+}
+
+// SpaceCadetsTranspiler [program.bbns [output.cpp]]
+// Writes the program as C++ to output.cpp, or to stdout if no output is given.
+// A program of "-" is read from stdin.
+// Build the result with any C++20 compiler, e.g. g++ -std=c++20 -O2 output.cpp
+int main(int argc, char** argv)
+{
+	auto path = (argc > 1) ? std::string{ argv[1] } : GetFilePathFromUser();
+	auto program_result = (path == "-") ? bbones::CreateProgramFromStream(std::cin) : bbones::CreateProgramFromFile(path);
+	if (!program_result.has_value())
+		throw std::runtime_error("Error: the provided filepath could not be opened!");
+
+	auto source = bbones::Transpiler{ CreateParser() }.Transpile(program_result.value());
+	if (argc <= 2) {
+		std::cout << source;
+		return 0;
+	}
+
+	std::ofstream output{ argv[2] };
+	if (!output)
+		throw std::runtime_error("Error: the output file could not be opened!");
+	output << source;
+	return 0;
+}
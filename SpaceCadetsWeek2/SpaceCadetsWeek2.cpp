@@ -1,5 +1,10 @@
 #include "lang.hpp"
+#include "analyzer.hpp"
+#include "vm.hpp"
+#include "optimizer.hpp"
+#include "superinstructions.hpp"
 #include <iostream>
+#include <map>
 
 bbones::Parser CreateParser()
 {
@@ -33,16 +38,93 @@ std::string GetFilePathFromUser()
 	return result;
 }
 
-int main()
+// A path of "-" reads the program itself from the rest of stdin
+std::optional<bbones::BaseProgram*> LoadProgram(const std::string& path)
 {
+	if (path == "-")
+		return bbones::CreateProgramFromStream(std::cin);
+	return bbones::CreateProgramFromFile(path);
+}
+
+// --vm runs the program on the bytecode VM instead of the tree-walker.
+// --profile (with --vm) also reports the most frequent instruction sequences.
+// --no-<pass> (with --vm) turns off one of the optimizer's passes, and
+// --optimizer-report lists what each pass changed.
+// --no-memoization (without --vm) runs every call to a pure function, and
+// --memo-report lists how often each one was skipped.
+// --no-check skips the analyzer: the program runs even if it has errors, and
+// checks every variable it uses as it goes.
+int main(int argc, char** argv)
+{
+	std::unordered_set<std::string> flags{ argv + 1, argv + argc };
+	bool use_vm = flags.contains("--vm");
+	bool profile = flags.contains("--profile");
+	bbones::OptimizerOptions optimizer{
+		!flags.contains("--no-constant-propagation"),
+		!flags.contains("--no-copy-propagation"),
+		!flags.contains("--no-constant-folding"),
+		!flags.contains("--no-dead-store-elimination"),
+		!flags.contains("--no-loop-invariant-code-motion"),
+		!flags.contains("--no-strength-reduction"),
+		!flags.contains("--no-loop-unrolling"),
+		!flags.contains("--no-inlining"),
+	};
+
 	auto parser = CreateParser();
-	auto program_result = bbones::CreateProgramFromFile(GetFilePathFromUser());
+	auto program_result = LoadProgram(GetFilePathFromUser());
 	if (!program_result.has_value())
 		throw std::runtime_error("Error: the provided filepath could not be opened!");
 	auto* program = program_result.value();
 
-	auto bones_instance = bbones::BareBones::Create(parser, program);
-	bones_instance.Execute();
+	// The interpreter reuses what the analysis proved to skip checks as it runs
+	std::vector<bbones::VariableAccess> accesses{};
+	if (!flags.contains("--no-check")) {
+		auto analysis = bbones::Analyzer{ parser }.Analyze(program);
+		for (const auto& diagnostic : analysis.diagnostics)
+			std::cerr << "statement " << diagnostic.statement + 1 << " (line " << program->GetLine(diagnostic.statement) << "): " << diagnostic.message << '\n';
+		if (!analysis.diagnostics.empty())
+			return 1;
+		accesses = std::move(analysis.accesses);
+	}
+
+	if (use_vm) {
+		auto code = bbones::Compiler{ parser }.Compile(program);
+		auto reports = bbones::Optimize(code, optimizer);
+		if (flags.contains("--optimizer-report")) {
+			for (const auto& report : reports)
+				std::cout << report.pass << ": rewrote " << report.rewritten << ", removed " << report.removed << '\n';
+		}
+		bbones::FuseSuperinstructions(code);
+
+		auto vm = bbones::VirtualMachine{ std::move(code) };
+		if (!profile) {
+			vm.Execute();
+		}
+		else {
+			vm.Profile();
+			for (const auto& sequence : vm.GetHotSequences(10)) {
+				std::cout << sequence.count << ':';
+				for (auto op : sequence.ops)
+					std::cout << ' ' << bbones::GetOpCodeName(op);
+				std::cout << '\n';
+			}
+		}
+	}
+	else {
+		auto bones_instance = bbones::BareBones::Create(parser, program, std::move(accesses));
+		bones_instance.SetMemoizing(!flags.contains("--no-memoization"));
+		bones_instance.Execute();
+
+		if (flags.contains("--memo-report")) {
+			std::map<std::string, bbones::FunctionCallStatement*> functions{};
+			for (const auto& [name, statement] : bones_instance.GetParser().m_mappings) {
+				if (auto* call = dynamic_cast<bbones::FunctionCallStatement*>(statement))
+					functions.insert({ name, call });
+			}
+			for (const auto& [name, call] : functions)
+				std::cout << name << ": " << call->GetMemoStats().hits << " hits, " << call->GetMemoStats().misses << " misses\n";
+		}
+	}
 	std::cout << "success!\n";
 
 	return 0;
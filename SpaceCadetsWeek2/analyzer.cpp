@@ -0,0 +1,386 @@
+#include "analyzer.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace bbones {
+
+namespace {
+	template <typename T>
+	bool IsA(IStatement* statement)
+	{
+		return dynamic_cast<T*>(statement) != nullptr;
+	}
+
+	std::optional<int> DecodeLiteral(const std::string& literal)
+	{
+		// Same conversion the interpreter performs when it evaluates the statement
+		try {
+			return std::stoi(literal);
+		}
+		catch (const std::exception&) {
+			return std::nullopt;
+		}
+	}
+
+	// function name ( a b ) do;
+	std::optional<std::vector<std::string>> DecodeParams(const std::vector<std::string>& words)
+	{
+		std::vector<std::string> params{};
+		bool started = false;
+		for (size_t i = 2; i < words.size(); i++)
+		{
+			if (words[i] == "(")
+				started = true;
+			else if (words[i] == ")")
+				return params;
+			else if (started)
+				params.push_back(words[i]);
+		}
+		return std::nullopt;
+	}
+
+	std::optional<int> Fold(Keyword op, int lhs, int rhs)
+	{
+		auto ulhs = static_cast<uint32_t>(lhs);
+		auto urhs = static_cast<uint32_t>(rhs);
+		switch (op)
+		{
+		case Keyword::Add:	return static_cast<int>(ulhs + urhs);
+		case Keyword::Sub:	return static_cast<int>(ulhs - urhs);
+		case Keyword::Mul:	return static_cast<int>(ulhs * urhs);
+		default:	break;
+		}
+		if (rhs == 0 || (lhs == std::numeric_limits<int>::min() && rhs == -1))
+			return std::nullopt;
+		return (op == Keyword::Div) ? lhs / rhs : lhs % rhs;
+	}
+}
+
+Analyzer::Analyzer(const Parser& parser)
+	: m_parser{ parser }
+{
+}
+
+void Analyzer::Report(const std::string& message)
+{
+	m_result.diagnostics.push_back({ m_ordinal, message });
+}
+
+bool Analyzer::Resolve(const std::string& name) const
+{
+	for (const auto& scope : m_frames.back().scopes)
+	{
+		if (scope.contains(name))
+			return true;
+	}
+	return false;
+}
+
+void Analyzer::Declare(const std::string& name)
+{
+	m_frames.back().scopes.back().insert(name);
+}
+
+// Once an unknown statement has run, variables may exist that were never declared here
+bool Analyzer::Use(const std::string& name)
+{
+	if (Resolve(name))
+		return true;
+	if (m_exact)
+		Report("Error: tried to access variable \"" + name + "\" when it does not exist!");
+	return false;
+}
+
+// Whether the keyword still means what the analyzer takes it to mean
+bool Analyzer::IsMappedTo(const std::string& keyword) const
+{
+	// In Keyword order
+	static constexpr std::array<bool (*)(IStatement*), keyword_count> kinds{
+		&IsA<InitStatement>,
+		&IsA<IncrementStatement>,
+		&IsA<DecrementStatement>,
+		&IsA<ClearStatement>,
+		&IsA<WhileStatement>,
+		&IsA<CopyStatement>,
+		&IsA<EndStatement>,
+		&IsA<IfStatement>,
+		&IsA<NoopStatement>,
+		&IsA<NoopStatement>,
+		&IsA<PrintStatement>,
+		&IsA<AddStatement>,
+		&IsA<SubStatement>,
+		&IsA<MulStatement>,
+		&IsA<DivStatement>,
+		&IsA<ModStatement>,
+		&IsA<SetStatement>,
+		&IsA<FunctionDefinitionStatement>,
+	};
+
+	auto builtin = FindKeyword(keyword);
+	if (!builtin.has_value())
+		return false;
+
+	auto statement = m_parser.GetStatementFor(builtin.value());
+	return statement.has_value() && kinds[static_cast<size_t>(builtin.value())](statement.value());
+}
+
+void Analyzer::FindFunctions(IProgram* program)
+{
+	for (size_t ordinal = 0; auto statement = program->Fetch(ordinal); ordinal++)
+	{
+		auto words = m_parser.ParseArgs(0, statement.value()).ToStrings();
+		if (words.size() < 2 || words[0] != "function" || m_parser.GetStatementFor(words[1]).has_value() || m_functions.contains(words[1]))
+			continue;
+
+		auto params = DecodeParams(words);
+		if (params.has_value())
+			m_functions.insert({ words[1], params.value().size() });
+	}
+}
+
+// Returns whether the variables tested exist
+bool Analyzer::AnalyzeCondition(const std::vector<std::string>& words)
+{
+	if (words.size() < 4)
+	{
+		Report("Error: malformed condition in \"" + words[0] + "\" statement.");
+		return false;
+	}
+
+	bool found = Use(words[1]);
+	if (!DecodeComparison(words[2]).has_value())
+		Report("Error: unknown comparison \"" + words[2] + "\".");
+	// Anything that is not an integer is a variable to compare with
+	if (!DecodeLiteral(words[3]).has_value())
+		found = Use(words[3]) && found;
+	return found;
+}
+
+// add X Y into Z
+void Analyzer::AnalyzeArithmetic(Keyword op, const std::vector<std::string>& words)
+{
+	const auto& keyword = words[0];
+	if (words.size() < 5)
+		return Report("Error: malformed \"" + keyword + "\" statement.");
+
+	bool found = Use(words[1]);
+	found = Use(words[2]) && found;
+	found = Use(words[4]) && found;
+	if (found && m_exact)
+		m_result.accesses[m_ordinal] = VariableAccess::Existing;
+
+	auto lhs = m_constants.find(words[1]);
+	auto rhs = m_constants.find(words[2]);
+	bool by_zero = (op == Keyword::Div || op == Keyword::Mod) && rhs != m_constants.end() && rhs->second == 0;
+	if (by_zero && m_exact)
+		Report("Error: division by zero in \"" + keyword + " " + words[1] + " " + words[2] + " into " + words[4] + "\".");
+
+	std::optional<int> result{};
+	if (lhs != m_constants.end() && rhs != m_constants.end())
+		result = Fold(op, lhs->second, rhs->second);
+	if (result.has_value())
+		m_constants[words[4]] = result.value();
+	else
+		m_constants.erase(words[4]);
+}
+
+void Analyzer::AnalyzeEnd()
+{
+	if (m_blocks.empty())
+		return Report("Unexpected end statement encountered during execution.");
+
+	auto block = m_blocks.back();
+	m_blocks.pop_back();
+	if (block.kind == BlockKind::Function)
+		m_frames.pop_back();
+	else
+		m_frames.back().scopes.pop_back();
+}
+
+void Analyzer::AnalyzeFunction(const std::vector<std::string>& words)
+{
+	auto params = DecodeParams(words);
+	if (!params.has_value())
+	{
+		bool started = std::find(words.begin(), words.end(), "(") != words.end();
+		Report(started ? "Error in function definition: expected \")\"." : "Error in function definition: expected \"(\".");
+	}
+
+	// The body gets a frame of its own, holding only the parameters when it starts
+	m_blocks.push_back({ BlockKind::Function, m_ordinal });
+	m_frames.push_back({ { {} } });
+	for (const auto& param : params.value_or(std::vector<std::string>{}))
+	{
+		if (Resolve(param))
+			Report("Tried to create variable \"" + param + "\" when that variable already exists!");
+		Declare(param);
+	}
+}
+
+void Analyzer::AnalyzeCall(const std::vector<std::string>& words)
+{
+	if (words.size() - 1 != m_functions.at(words[0]))
+		return Report("Incorrect number of arguments passed to function call.");
+
+	bool found = true;
+	for (size_t i = 1; i < words.size(); i++)
+		found = Use(words[i]) && found;
+	if (found && m_exact)
+		m_result.accesses[m_ordinal] = VariableAccess::Existing;
+}
+
+void Analyzer::AnalyzeStatement(const std::string& statement)
+{
+	// keyword followed by arguments
+	auto words = m_parser.ParseArgs(0, statement).ToStrings();
+	if (words.empty() || !m_parser.GetStatementFor(words[0]).has_value())
+	{
+		if (!words.empty() && m_functions.contains(words[0]))
+			AnalyzeCall(words);
+		else
+			Report("BareBones: instruction " + statement + " is not recognised!");
+		return;
+	}
+
+	const auto& keyword = words[0];
+	if (!IsMappedTo(keyword))
+	{
+		m_exact = false;
+		m_constants.clear();
+		return;
+	}
+
+	auto malformed = [&]() { Report("Error: malformed \"" + keyword + "\" statement."); };
+	auto& access = m_result.accesses[m_ordinal];
+	auto builtin = FindKeyword(keyword).value();
+	switch (builtin)
+	{
+	case Keyword::Init:
+	{
+		if (words.size() < 2)
+			return malformed();
+		if (Resolve(words[1]) && m_exact)
+			Report("Tried to create variable \"" + words[1] + "\" when that variable already exists!");
+		else if (m_exact)
+			access = VariableAccess::New;
+		Declare(words[1]);
+		m_constants[words[1]] = 0;
+		break;
+	}
+	case Keyword::Set:
+	{
+		// set X 10 - assigns if X is visible, otherwise declares it in the current block
+		if (words.size() < 3)
+			return malformed();
+		auto literal = DecodeLiteral(words[2]);
+		if (!literal.has_value())
+			return Report("Error: \"" + words[2] + "\" is not an integer.");
+		if (m_exact)
+			access = Resolve(words[1]) ? VariableAccess::Existing : VariableAccess::New;
+		if (!Resolve(words[1]))
+			Declare(words[1]);
+		m_constants[words[1]] = literal.value();
+		break;
+	}
+	case Keyword::Incr:
+	case Keyword::Decr:
+	case Keyword::Clear:
+	case Keyword::Print:
+	{
+		if (words.size() < 2)
+			return malformed();
+		if (Use(words[1]) && m_exact)
+			access = VariableAccess::Existing;
+
+		auto value = m_constants.find(words[1]);
+		if (builtin == Keyword::Clear)
+			m_constants[words[1]] = 0;
+		else if (value != m_constants.end() && builtin != Keyword::Print)
+			value->second = Fold((builtin == Keyword::Incr) ? Keyword::Add : Keyword::Sub, value->second, 1).value();
+		break;
+	}
+	case Keyword::Copy:
+	{
+		// copy X to Y
+		if (words.size() < 4)
+			return malformed();
+		bool found = Use(words[1]);
+		if (Use(words[3]) && found && m_exact)
+			access = VariableAccess::Existing;
+
+		auto value = m_constants.find(words[1]);
+		if (value != m_constants.end())
+			m_constants[words[3]] = value->second;
+		else
+			m_constants.erase(words[3]);
+		break;
+	}
+	case Keyword::Add:
+	case Keyword::Sub:
+	case Keyword::Mul:
+	case Keyword::Div:
+	case Keyword::Mod:
+		AnalyzeArithmetic(builtin, words);
+		break;
+	// Values only stay known within straight line code, so every block
+	// boundary below forgets them
+	case Keyword::While:
+	case Keyword::If:
+		if (AnalyzeCondition(words) && m_exact)
+			access = VariableAccess::Existing;
+		m_blocks.push_back({ (builtin == Keyword::While) ? BlockKind::While : BlockKind::If, m_ordinal });
+		m_frames.back().scopes.push_back({});
+		m_constants.clear();
+		break;
+	case Keyword::Elif:
+	case Keyword::Else:
+		// Outside of an if these are no-ops. Inside one, each branch gets a
+		// scope of its own and conditions are tested from the if's scope.
+		if (m_blocks.empty() || m_blocks.back().kind != BlockKind::If)
+			return;
+		m_constants.clear();
+		m_frames.back().scopes.pop_back();
+		if (builtin == Keyword::Elif && AnalyzeCondition(words) && m_exact)
+			access = VariableAccess::Existing;
+		m_frames.back().scopes.push_back({});
+		break;
+	case Keyword::End:
+		AnalyzeEnd();
+		m_constants.clear();
+		break;
+	case Keyword::Function:
+		AnalyzeFunction(words);
+		m_constants.clear();
+		break;
+	}
+}
+
+Analysis Analyzer::Analyze(IProgram* program)
+{
+	m_result = {};
+	m_blocks.clear();
+	m_frames.clear();
+	m_functions.clear();
+	m_constants.clear();
+	m_exact = true;
+
+	m_frames.push_back({ { {} } });
+	FindFunctions(program);
+
+	for (size_t ordinal = 0; auto statement = program->Fetch(ordinal); ordinal++)
+	{
+		m_ordinal = ordinal;
+		m_result.accesses.push_back(VariableAccess::Unchecked);
+		AnalyzeStatement(std::string{ statement.value() });
+	}
+
+	// Running off the end of the program inside a block is an error
+	for (const auto& block : m_blocks)
+	{
+		m_ordinal = block.opener;
+		Report("Error: missing end statement.");
+	}
+	return std::move(m_result);
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "common.hpp"
+#include "lang.hpp"
+
+namespace bbones {
+
+// An error the interpreter would raise once the statement is reached
+struct Diagnostic {
+	size_t statement{};				// ordinal in the program
+	std::string message{};
+};
+
+struct Analysis {
+	std::vector<Diagnostic> diagnostics{};
+	std::vector<VariableAccess> accesses{};		// one per statement
+};
+
+// Checks a whole program before it runs. Statements are recognised by
+// keyword as in Compiler, and scopes follow the blocks of the program text,
+// which is exactly how the interpreter scopes variables. Finds:
+//
+//	- variables used where no init, set or parameter has declared them
+//	- init of a variable that is already visible
+//	- blocks left open at the end of the program, and ends closing nothing
+//	- calls passing the wrong number of arguments, or to no function at all
+//	- malformed statements and literals
+//	- division by a variable known to be zero at that point
+//
+// Functions may be called before their definition in the text, as long as
+// the definition has run by then, so calls are checked against every
+// definition in the program.
+class Analyzer {
+private:
+	enum class BlockKind {
+		While,
+		If,
+		Function,
+	};
+
+	struct OpenBlock {
+		BlockKind kind{};
+		size_t opener{};
+	};
+
+	// The top level or a function body. Lookups never cross a frame.
+	struct FrameInfo {
+		std::vector<std::unordered_set<std::string>> scopes{};
+	};
+
+	Parser m_parser{};
+	Analysis m_result{};
+	size_t m_ordinal{};
+	std::vector<OpenBlock> m_blocks{};
+	std::vector<FrameInfo> m_frames{};
+	std::unordered_map<std::string, size_t> m_functions{};		// name to number of parameters, first definition wins
+	std::unordered_map<std::string, int> m_constants{};		// values known since the last block boundary
+	bool m_exact{true};											// false after a statement the analyzer does not know
+
+	void Report(const std::string& message);
+	bool Resolve(const std::string& name) const;
+	void Declare(const std::string& name);
+	bool Use(const std::string& name);
+	bool IsMappedTo(const std::string& keyword) const;
+
+	void FindFunctions(IProgram* program);
+	void AnalyzeStatement(const std::string& statement);
+	bool AnalyzeCondition(const std::vector<std::string>& words);
+	void AnalyzeArithmetic(Keyword op, const std::vector<std::string>& words);
+	void AnalyzeEnd();
+	void AnalyzeFunction(const std::vector<std::string>& words);
+	void AnalyzeCall(const std::vector<std::string>& words);
+
+public:
+	Analyzer(const Parser& parser);
+
+	Analysis Analyze(IProgram* program);
+};
+
+}
@@ -0,0 +1,473 @@
+#include "compiler.hpp"
+
+namespace bbones {
+
+namespace {
+	std::optional<int32_t> DecodeLiteral(std::string_view literal)
+	{
+		// Same conversion the interpreter performs when it evaluates the statement
+		try {
+			return std::stoi(std::string{ literal });
+		}
+		catch (const std::exception&) {
+			return std::nullopt;
+		}
+	}
+
+	OpCode UnaryOpCode(Keyword keyword)
+	{
+		switch (keyword)
+		{
+		case Keyword::Incr:	return OpCode::Incr;
+		case Keyword::Decr:	return OpCode::Decr;
+		case Keyword::Clear:	return OpCode::Clear;
+		default:	return OpCode::Print;
+		}
+	}
+
+	OpCode ArithmeticOpCode(Keyword keyword)
+	{
+		switch (keyword)
+		{
+		case Keyword::Add:	return OpCode::Add;
+		case Keyword::Sub:	return OpCode::Sub;
+		case Keyword::Mul:	return OpCode::Mul;
+		case Keyword::Div:	return OpCode::Div;
+		default:	return OpCode::Mod;
+		}
+	}
+}
+
+std::string_view GetOpCodeName(OpCode op)
+{
+	static constexpr std::string_view names[]{
+		"init", "incr", "decr", "clear", "copy", "set", "add", "sub", "mul", "div", "mod", "print",
+		"while", "if", "else", "end", "function", "call", "return", "loop", "fault", "halt",
+		"end-while", "step-end-while", "copy-copy", "add-rotate",
+	};
+	return names[static_cast<size_t>(op)];
+}
+
+Compiler::Compiler(const Parser& parser)
+	: m_parser{parser}
+{
+}
+
+int32_t Compiler::Emit(const Instruction& insn)
+{
+	m_result.code.push_back(insn);
+	return Here() - 1;
+}
+
+int32_t Compiler::Here() const
+{
+	return static_cast<int32_t>(m_result.code.size());
+}
+
+int32_t Compiler::NameId(std::string_view name)
+{
+	auto it = m_name_ids.find(name);
+	if (it != m_name_ids.end())
+		return it->second;
+
+	auto id = static_cast<int32_t>(m_result.names.size());
+	m_result.names.emplace_back(name);
+	m_name_ids.emplace(name, id);
+	return id;
+}
+
+int32_t Compiler::MessageId(const std::string& message)
+{
+	m_result.messages.push_back(message);
+	return static_cast<int32_t>(m_result.messages.size()) - 1;
+}
+
+void Compiler::PushScope()
+{
+	auto& frame = m_frames.back();
+	frame.scopes.push_back({ {}, frame.next_slot });
+}
+
+void Compiler::PopScope()
+{
+	auto& frame = m_frames.back();
+	frame.next_slot = frame.scopes.back().first_slot;
+	frame.scopes.pop_back();
+}
+
+// Follows Scope::GetVariable: innermost block first, never past the frame
+std::optional<int32_t> Compiler::Resolve(std::string_view name) const
+{
+	const auto& scopes = m_frames.back().scopes;
+	for (auto it = scopes.rbegin(); it != scopes.rend(); it++)
+	{
+		auto slot = it->slots.find(name);
+		if (slot != it->slots.end())
+			return slot->second;
+	}
+	return std::nullopt;
+}
+
+int32_t Compiler::Declare(std::string_view name)
+{
+	auto& frame = m_frames.back();
+	auto slot = frame.next_slot++;
+	frame.size = std::max(frame.size, frame.next_slot);
+	frame.scopes.back().slots.emplace(name, slot);
+	return slot;
+}
+
+// Resolve a variable that must already exist, faulting like macros::GetVariable if it does not
+std::optional<int32_t> Compiler::Use(std::string_view name)
+{
+	auto slot = Resolve(name);
+	if (!slot.has_value())
+		EmitFault("Error: tried to access variable \"" + std::string{ name } + "\" when it does not exist!");
+	return slot;
+}
+
+// Errors the interpreter would raise when reaching a statement are deferred
+// to the same point of execution instead of failing the whole compile.
+void Compiler::EmitFault(const std::string& message)
+{
+	Emit({ OpCode::Fault, {}, MessageId(message) });
+}
+
+void Compiler::CompileCondition(OpCode op, const Tokens& words, size_t at)
+{
+	// On failure the block opener is still emitted so that the block structure stays intact
+	if (words.size() < at + 3)
+	{
+		EmitFault("Error: malformed condition in \"" + std::string{ words[0] } + "\" statement.");
+		Emit({ op, Comparison::Always });
+		return;
+	}
+
+	auto slot = Use(words[at]);
+	auto cmp = DecodeComparison(words[at + 1]);
+	if (slot.has_value() && !cmp.has_value())
+		EmitFault("Error: unknown comparison \"" + std::string{ words[at + 1] } + "\".");
+
+	// Anything that is not an integer is a variable to compare with
+	auto literal = DecodeLiteral(words[at + 2]);
+	if (slot.has_value() && cmp.has_value() && !literal.has_value())
+	{
+		auto rhs = Use(words[at + 2]);
+		Emit({ op, cmp.value(), slot.value(), rhs.value_or(0), {}, {}, rhs.has_value() });
+		return;
+	}
+
+	Emit({ op, cmp.value_or(Comparison::Always), slot.value_or(0), literal.value_or(0) });
+}
+
+void Compiler::CompileElse(const Tokens& words, bool has_condition)
+{
+	// Outside of an if block the branch keywords are no-ops, as in the interpreter
+	if (m_blocks.empty() || m_blocks.back().kind != BlockKind::If)
+		return;
+
+	auto& block = m_blocks.back();
+	PopScope();
+	block.exits.push_back(Emit({ OpCode::Else }));
+	m_result.code[block.opener].target = Here();
+
+	if (has_condition)
+		CompileCondition(OpCode::If, words, 1);
+	else
+		Emit({ OpCode::If, Comparison::Always });
+	block.opener = Here() - 1;
+	PushScope();
+}
+
+void Compiler::CompileEnd()
+{
+	if (m_blocks.empty())
+	{
+		EmitFault(EndStatementException{}.what());
+		return;
+	}
+
+	auto block = m_blocks.back();
+	m_blocks.pop_back();
+
+	switch (block.kind)
+	{
+	case BlockKind::While:
+		PopScope();
+		Emit({ OpCode::End, {}, {}, {}, {}, block.opener });
+		m_result.code[block.opener].target = Here();
+		break;
+	case BlockKind::If:
+		PopScope();
+		Emit({ OpCode::End, {}, {}, {}, {}, Here() + 1 });
+		m_result.code[block.opener].target = Here();
+		for (auto exit : block.exits)
+			m_result.code[exit].target = Here();
+		break;
+	case BlockKind::Function: {
+		auto function_id = m_frames.back().function_id;
+		if (function_id >= 0)
+			m_result.functions[function_id].frame_size = m_frames.back().size;
+		m_frames.pop_back();
+		Emit({ OpCode::Return });
+		m_result.code[block.opener].target = Here();
+		break;
+	}
+	}
+}
+
+// function name ( a b ) do;
+void Compiler::CompileFunction(const Tokens& words)
+{
+	std::vector<std::string> params{};
+	bool started = false;
+	bool finished = false;
+	for (size_t i = 2; i < words.size() && !finished; i++)
+	{
+		if (words[i] == "(")
+			started = true;
+		else if (words[i] == ")")
+			finished = true;
+		else if (started)
+			params.emplace_back(words[i]);
+	}
+
+	if (words.size() < 2 || !finished)
+		EmitFault(started ? "Error in function definition: expected \")\"." : "Error in function definition: expected \"(\".");
+
+	auto opener = Emit({ OpCode::Function });
+	m_blocks.push_back({ BlockKind::Function, opener });
+
+	// The body gets a frame of its own with the parameters in its first slots
+	m_frames.push_back({});
+	PushScope();
+	std::vector<int32_t> param_slots{};
+	std::optional<std::string> duplicate{};
+	for (const auto& param : params)
+	{
+		if (Resolve(param).has_value())
+			duplicate = param;
+		param_slots.push_back(Declare(param));
+	}
+	if (duplicate.has_value())
+		EmitFault("Tried to create variable \"" + duplicate.value() + "\" when that variable already exists!");
+
+	// Registered before the body is compiled so that functions may recurse.
+	// As with Parser::AddMapping, the first definition of a name wins.
+	if (words.size() >= 2 && !m_function_ids.contains(words[1]))
+	{
+		auto function_id = static_cast<int32_t>(m_result.functions.size());
+		m_function_ids.emplace(words[1], function_id);
+		m_result.functions.push_back({ std::string{ words[1] }, opener + 1, param_slots });
+		m_frames.back().function_id = function_id;
+	}
+}
+
+void Compiler::CompileCall(int32_t function_id, const Tokens& words)
+{
+	const auto& function = m_result.functions[function_id];
+	if (words.size() - 1 != function.params.size())
+	{
+		EmitFault("Incorrect number of arguments passed to function call.");
+		return;
+	}
+
+	std::vector<int32_t> args{};
+	for (size_t i = 1; i < words.size(); i++)
+	{
+		auto slot = Use(words[i]);
+		if (!slot.has_value())
+			return;
+		args.push_back(slot.value());
+	}
+
+	auto offset = static_cast<int32_t>(m_result.operands.size());
+	m_result.operands.insert(m_result.operands.end(), args.begin(), args.end());
+
+	Emit({ OpCode::Call, {}, function_id, offset, static_cast<int32_t>(words.size() - 1) });
+}
+
+// Replace a loop SummariseLoop recognises with a single instruction. Returns
+// the end of the loop, or None to compile it statement by statement.
+std::optional<ExecutionCursor> Compiler::CompileLoopIdiom(IProgram* program, const BlockTable& blocks, const ExecutionCursor& opener)
+{
+	auto summary = SummariseLoop(program, blocks, opener);
+	if (!summary.has_value())
+		return std::nullopt;
+
+	// Missing variables fault part way through the loop, which needs the loop itself
+	std::vector<int32_t> slots{};
+	for (const auto& name : summary.value().GetVariables())
+	{
+		auto slot = Resolve(name);
+		if (!slot.has_value())
+			return std::nullopt;
+		slots.push_back(slot.value());
+	}
+
+	auto loop_id = static_cast<int32_t>(m_result.loops.size());
+	auto offset = static_cast<int32_t>(m_result.operands.size());
+	m_result.loops.push_back(summary.value());
+	m_result.operands.insert(m_result.operands.end(), slots.begin(), slots.end());
+
+	Emit({ OpCode::Loop, {}, loop_id, offset, static_cast<int32_t>(slots.size()) });
+	return blocks.GetEnd(opener);
+}
+
+void Compiler::CompileStatement(std::string_view statement)
+{
+	// keyword followed by arguments
+	auto words = Tokenize(statement);
+	if (words.empty() || !m_parser.GetStatementFor(words[0]).has_value())
+	{
+		auto function = words.empty() ? m_function_ids.end() : m_function_ids.find(words[0]);
+		if (function == m_function_ids.end())
+			EmitFault("BareBones: instruction " + std::string{ statement } + " is not recognised!");
+		else
+			CompileCall(function->second, words);
+		return;
+	}
+
+	auto keyword = words[0];
+	auto malformed = [&]() { EmitFault("Error: malformed \"" + std::string{ keyword } + "\" statement."); };
+
+	auto builtin = FindKeyword(keyword);
+	if (!builtin.has_value())
+		return EmitFault("Error: \"" + std::string{ keyword } + "\" statements cannot be compiled.");
+
+	switch (builtin.value())
+	{
+	case Keyword::Init:
+	{
+		if (words.size() < 2)
+			return malformed();
+		if (Resolve(words[1]).has_value())
+			return EmitFault("Tried to create variable \"" + std::string{ words[1] } + "\" when that variable already exists!");
+		Emit({ OpCode::Init, {}, Declare(words[1]) });
+		break;
+	}
+	case Keyword::Incr:
+	case Keyword::Decr:
+	case Keyword::Clear:
+	case Keyword::Print:
+	{
+		if (words.size() < 2)
+			return malformed();
+		auto op = UnaryOpCode(builtin.value());
+		auto slot = Use(words[1]);
+		auto name = (op == OpCode::Print) ? NameId(words[1]) : 0;
+		if (slot.has_value())
+			Emit({ op, {}, slot.value(), name });
+		break;
+	}
+	case Keyword::Add:
+	case Keyword::Sub:
+	case Keyword::Mul:
+	case Keyword::Div:
+	case Keyword::Mod:
+	{
+		// add X Y into Z
+		if (words.size() < 5)
+			return malformed();
+		auto lhs = Use(words[1]);
+		auto rhs = lhs.has_value() ? Use(words[2]) : std::nullopt;
+		auto into = rhs.has_value() ? Use(words[4]) : std::nullopt;
+		if (into.has_value())
+			Emit({ ArithmeticOpCode(builtin.value()), {}, lhs.value(), rhs.value(), into.value() });
+		break;
+	}
+	case Keyword::Copy:
+	{
+		// copy X to Y
+		if (words.size() < 4)
+			return malformed();
+		auto src = Use(words[1]);
+		auto dst = src.has_value() ? Use(words[3]) : std::nullopt;
+		if (dst.has_value())
+			Emit({ OpCode::Copy, {}, src.value(), {}, dst.value() });
+		break;
+	}
+	case Keyword::Set:
+	{
+		// set X 10 - assigns if X is visible, otherwise declares it in the current block
+		if (words.size() < 3)
+			return malformed();
+		auto literal = DecodeLiteral(words[2]);
+		if (!literal.has_value())
+			return EmitFault("Error: \"" + std::string{ words[2] } + "\" is not an integer.");
+		auto slot = Resolve(words[1]);
+		Emit({ OpCode::Set, {}, {}, literal.value(), slot.has_value() ? slot.value() : Declare(words[1]) });
+		break;
+	}
+	case Keyword::While:
+		CompileCondition(OpCode::While, words, 1);
+		m_blocks.push_back({ BlockKind::While, Here() - 1 });
+		PushScope();
+		break;
+	case Keyword::If:
+		CompileCondition(OpCode::If, words, 1);
+		m_blocks.push_back({ BlockKind::If, Here() - 1 });
+		PushScope();
+		break;
+	case Keyword::Elif:
+		CompileElse(words, true);
+		break;
+	case Keyword::Else:
+		CompileElse(words, false);
+		break;
+	case Keyword::End:
+		CompileEnd();
+		break;
+	case Keyword::Function:
+		CompileFunction(words);
+		break;
+	}
+}
+
+Bytecode Compiler::Compile(IProgram* program)
+{
+	m_result = {};
+	m_blocks.clear();
+	m_frames.clear();
+	m_name_ids.clear();
+	m_function_ids.clear();
+
+	m_frames.push_back({});
+	PushScope();
+
+	// Loop idioms are only recognised by keyword, so the keywords have to be in use
+	BlockTable blocks{ program };
+	bool fuse_loops = true;
+	for (const auto* keyword : { "while", "end", "incr", "decr", "clear", "copy", "add", "sub" })
+		fuse_loops = fuse_loops && m_parser.GetStatementFor(keyword).has_value();
+
+	for (size_t ordinal = 0; auto statement = program->Fetch(ordinal); ordinal++)
+	{
+		auto loop_end = fuse_loops ? CompileLoopIdiom(program, blocks, ordinal) : std::nullopt;
+		if (loop_end.has_value())
+			ordinal = loop_end.value().GetOrdinal();
+		else
+			CompileStatement(statement.value());
+	}
+
+	// Running off the end of the program inside a block is an error
+	if (!m_blocks.empty())
+	{
+		auto fault = Here();
+		EmitFault("Error: missing end statement.");
+		for (auto& block : m_blocks)
+		{
+			m_result.code[block.opener].target = fault;
+			for (auto exit : block.exits)
+				m_result.code[exit].target = fault;
+		}
+		m_blocks.clear();
+	}
+
+	Emit({ OpCode::Halt });
+	m_result.frame_size = m_frames.front().size;
+	m_result.globals = m_frames.front().scopes.front().slots;
+	return std::move(m_result);
+}
+
+}
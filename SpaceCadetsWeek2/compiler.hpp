@@ -0,0 +1,137 @@
+#pragma once
+#include "common.hpp"
+#include "lang.hpp"
+#include "idioms.hpp"
+
+namespace bbones {
+
+enum class OpCode : uint8_t {
+	Init,			// init a;
+	Incr,			// incr a;
+	Decr,			// decr a;
+	Clear,			// clear a;
+	Copy,			// copy a to c;
+	Set,			// set c b;
+	Add,			// add a b into c;
+	Sub,
+	Mul,
+	Div,
+	Mod,
+	Print,			// print a; (b is the name to print)
+	While,			// enter body if condition holds, otherwise jump to target
+	If,				// enter branch if condition holds, otherwise jump to target (next branch test)
+	Else,			// fell out of a taken branch: jump to target (past the end)
+	End,			// jump to target
+	Function,		// skip over a function body at its definition site
+	Call,			// call function a with c arguments starting at operands[b]
+	Return,
+	Loop,			// run loops[a] over the c slots starting at operands[b]
+	Fault,			// throw messages[a]
+	Halt,
+
+	// Superinstructions, see FuseSuperinstructions
+	EndWhile,		// End + While: re-test the while at target in place
+	StepEndWhile,	// Incr/Decr + EndWhile: add b to a, then re-test the while at target
+	CopyCopy,		// copy a to c; copy b to target;
+	AddRotate,		// add a b into c; copy b to a; copy c to b;
+};
+
+std::string_view GetOpCodeName(OpCode op);
+
+// Operands are pre-decoded at compile time. Variables are slots in the
+// enclosing frame, literals are stored inline. Conditions compare slot a
+// with the literal b, or with slot b if slot_b is set.
+struct Instruction {
+	OpCode op{};
+	Comparison cmp{};
+	int32_t a{};
+	int32_t b{};
+	int32_t c{};
+	int32_t target{};
+	bool slot_b{};
+};
+
+struct FunctionInfo {
+	std::string name{};
+	int32_t entry{};
+	std::vector<int32_t> params{};		// slots the arguments are copied into
+	int32_t frame_size{};
+};
+
+struct Bytecode {
+	std::vector<Instruction> code{};
+	std::vector<std::string> names{};
+	std::vector<std::string> messages{};
+	std::vector<int32_t> operands{};
+	std::vector<FunctionInfo> functions{};
+	std::vector<LoopSummary> loops{};
+	int32_t frame_size{};							// slots used by the top level
+	StringMap<int32_t> globals{};					// top level variables still in scope at the end
+};
+
+// Lowers a whole program into bytecode ahead of execution. Statements are
+// identified by keyword (as IfStatement does for its branches) and must be
+// registered with the parser to be recognised.
+class Compiler {
+private:
+	enum class BlockKind {
+		While,
+		If,
+		Function,
+	};
+
+	struct OpenBlock {
+		BlockKind kind{};
+		int32_t opener{};					// While/Function instruction, or the latest branch test of an if
+		std::vector<int32_t> exits{};		// Else instructions to patch with the end of an if
+	};
+
+	// Variables declared by one block. Slots are handed out stack-wise and
+	// reclaimed when the block ends.
+	struct ScopeInfo {
+		StringMap<int32_t> slots{};
+		int32_t first_slot{};
+	};
+
+	// The top level or a function body. Lookups never cross a frame.
+	struct FrameInfo {
+		std::vector<ScopeInfo> scopes{};
+		int32_t next_slot{};
+		int32_t size{};
+		int32_t function_id{-1};
+	};
+
+	Parser m_parser{};
+	Bytecode m_result{};
+	std::vector<OpenBlock> m_blocks{};
+	std::vector<FrameInfo> m_frames{};
+	StringMap<int32_t> m_name_ids{};
+	StringMap<int32_t> m_function_ids{};
+
+	void PushScope();
+	void PopScope();
+	std::optional<int32_t> Resolve(std::string_view name) const;
+	int32_t Declare(std::string_view name);
+	std::optional<int32_t> Use(std::string_view name);
+
+	int32_t Emit(const Instruction& insn);
+	int32_t Here() const;
+	int32_t NameId(std::string_view name);
+	int32_t MessageId(const std::string& message);
+	void EmitFault(const std::string& message);
+
+	std::optional<ExecutionCursor> CompileLoopIdiom(IProgram* program, const BlockTable& blocks, const ExecutionCursor& opener);
+	void CompileStatement(std::string_view statement);
+	void CompileCondition(OpCode op, const Tokens& words, size_t at);
+	void CompileElse(const Tokens& words, bool has_condition);
+	void CompileEnd();
+	void CompileFunction(const Tokens& words);
+	void CompileCall(int32_t function_id, const Tokens& words);
+
+public:
+	Compiler(const Parser& parser);
+
+	Bytecode Compile(IProgram* program);
+};
+
+}
@@ -0,0 +1,359 @@
+#include "dataflow.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace bbones {
+
+namespace {
+	// Forward dataflow from the top level and every function entry, with
+	// nothing known on entry. `transfer` turns the state before an
+	// instruction into the state after it and returns where execution may
+	// continue, `meet` merges a state into another and reports any change.
+	// States stay None for instructions that can never run.
+	template <typename State, typename Transfer, typename Meet>
+	std::vector<std::optional<State>> SolveForward(const Bytecode& code, const State& entry, Transfer transfer, Meet meet)
+	{
+		std::vector<std::optional<State>> states(code.code.size());
+		std::vector<int32_t> work{ 0 };
+		states[0] = entry;
+		for (const auto& function : code.functions)
+		{
+			states[function.entry] = entry;
+			work.push_back(function.entry);
+		}
+
+		while (!work.empty())
+		{
+			auto at = work.back();
+			work.pop_back();
+
+			auto state = states[at].value();
+			for (auto next : transfer(at, state))
+			{
+				if (!states[next].has_value())
+				{
+					states[next] = state;
+					work.push_back(next);
+				}
+				else if (meet(states[next].value(), state))
+				{
+					work.push_back(next);
+				}
+			}
+		}
+		return states;
+	}
+}
+
+bool HasTarget(OpCode op)
+{
+	return op == OpCode::While || op == OpCode::If || op == OpCode::Else || op == OpCode::End || op == OpCode::Function;
+}
+
+std::vector<int32_t> GetSuccessors(const Instruction& insn, int32_t at)
+{
+	switch (insn.op)
+	{
+	case OpCode::While:
+	case OpCode::If:
+		if (insn.cmp == Comparison::Always)
+			return { at + 1 };
+		return { at + 1, insn.target };
+	case OpCode::Else:
+	case OpCode::End:
+	case OpCode::Function:
+		return { insn.target };
+	case OpCode::Return:
+	case OpCode::Fault:
+	case OpCode::Halt:
+		return {};
+	default:
+		return { at + 1 };
+	}
+}
+
+std::span<int32_t> GetOperands(Bytecode& code, const Instruction& insn)
+{
+	return { code.operands.data() + insn.b, static_cast<size_t>(insn.c) };
+}
+
+std::vector<int32_t> GetReads(Bytecode& code, const Instruction& insn)
+{
+	switch (insn.op)
+	{
+	case OpCode::Incr:
+	case OpCode::Decr:
+	case OpCode::Copy:
+	case OpCode::Print:
+		return { insn.a };
+	case OpCode::Add:
+	case OpCode::Sub:
+	case OpCode::Mul:
+	case OpCode::Div:
+	case OpCode::Mod:
+		return { insn.a, insn.b };
+	case OpCode::While:
+	case OpCode::If:
+		if (insn.cmp == Comparison::Always)
+			return {};
+		if (insn.slot_b)
+			return { insn.a, insn.b };
+		return { insn.a };
+	case OpCode::Call:
+	case OpCode::Loop: {
+		auto operands = GetOperands(code, insn);
+		return { operands.begin(), operands.end() };
+	}
+	default:
+		return {};
+	}
+}
+
+std::vector<int32_t> GetWrites(Bytecode& code, const Instruction& insn)
+{
+	switch (insn.op)
+	{
+	case OpCode::Init:
+	case OpCode::Clear:
+	case OpCode::Incr:
+	case OpCode::Decr:
+		return { insn.a };
+	case OpCode::Copy:
+	case OpCode::Set:
+	case OpCode::Add:
+	case OpCode::Sub:
+	case OpCode::Mul:
+	case OpCode::Div:
+	case OpCode::Mod:
+		return { insn.c };
+	case OpCode::Loop: {
+		auto operands = GetOperands(code, insn);
+		return { operands.begin(), operands.end() };
+	}
+	default:
+		return {};
+	}
+}
+
+std::optional<int32_t> Fold(OpCode op, int32_t lhs, int32_t rhs)
+{
+	auto ulhs = static_cast<uint32_t>(lhs);
+	auto urhs = static_cast<uint32_t>(rhs);
+	switch (op)
+	{
+	case OpCode::Add:	return static_cast<int32_t>(ulhs + urhs);
+	case OpCode::Sub:	return static_cast<int32_t>(ulhs - urhs);
+	case OpCode::Mul:	return static_cast<int32_t>(ulhs * urhs);
+	default:			break;
+	}
+
+	if (rhs == 0 || (lhs == std::numeric_limits<int32_t>::min() && rhs == -1))
+		return std::nullopt;
+	return (op == OpCode::Div) ? lhs / rhs : lhs % rhs;
+}
+
+bool IsConditionTrue(Comparison cmp, int32_t value, int32_t literal)
+{
+	switch (cmp)
+	{
+	case Comparison::Is:	return value == literal;
+	case Comparison::Not:	return value != literal;
+	case Comparison::Lt:	return value < literal;
+	case Comparison::Lte:	return value <= literal;
+	case Comparison::Gt:	return value > literal;
+	case Comparison::Gte:	return value >= literal;
+	default:				return true;
+	}
+}
+
+std::optional<int32_t> GetComparand(const Instruction& insn, const Constants& values)
+{
+	if (insn.slot_b)
+		return values[insn.b];
+	return insn.b;
+}
+
+size_t GetSlotCount(const Bytecode& code)
+{
+	auto count = code.frame_size;
+	for (const auto& function : code.functions)
+		count = std::max(count, function.frame_size);
+	return static_cast<size_t>(count);
+}
+
+std::vector<int32_t> GetFrames(const Bytecode& code)
+{
+	// Bodies nested in another start later, so they overwrite the outer one
+	std::vector<int32_t> frames(code.code.size(), -1);
+	for (int32_t at{}; at < static_cast<int32_t>(code.code.size()); at++)
+	{
+		if (code.code[at].op == OpCode::Function)
+			std::fill(frames.begin() + at + 1, frames.begin() + code.code[at].target, at);
+	}
+	return frames;
+}
+
+std::vector<int32_t> TransferConstants(Bytecode& code, int32_t at, Constants& values)
+{
+	const auto& insn = code.code[at];
+	switch (insn.op)
+	{
+	case OpCode::Init:
+	case OpCode::Clear:
+		values[insn.a] = 0;
+		break;
+	case OpCode::Incr:
+	case OpCode::Decr:
+		if (values[insn.a].has_value())
+			values[insn.a] = Fold(OpCode::Add, values[insn.a].value(), (insn.op == OpCode::Incr) ? 1 : -1);
+		break;
+	case OpCode::Copy:
+		values[insn.c] = values[insn.a];
+		break;
+	case OpCode::Set:
+		values[insn.c] = insn.b;
+		break;
+	case OpCode::Add:
+	case OpCode::Sub:
+	case OpCode::Mul:
+	case OpCode::Div:
+	case OpCode::Mod:
+		values[insn.c] = (values[insn.a].has_value() && values[insn.b].has_value())
+			? Fold(insn.op, values[insn.a].value(), values[insn.b].value())
+			: std::nullopt;
+		break;
+	case OpCode::Loop:
+		for (auto slot : GetOperands(code, insn))
+			values[slot] = std::nullopt;
+		break;
+	case OpCode::While:
+	case OpCode::If:
+		if (insn.cmp != Comparison::Always && values[insn.a].has_value() && GetComparand(insn, values).has_value())
+			return { IsConditionTrue(insn.cmp, values[insn.a].value(), GetComparand(insn, values).value()) ? at + 1 : insn.target };
+		break;
+	default:
+		break;
+	}
+	return GetSuccessors(insn, at);
+}
+
+std::vector<std::optional<Constants>> FindConstants(Bytecode& code)
+{
+	auto transfer = [&](int32_t at, Constants& values) { return TransferConstants(code, at, values); };
+
+	auto meet = [](Constants& into, const Constants& from) {
+		bool changed = false;
+		for (size_t slot{}; slot < into.size(); slot++)
+		{
+			if (into[slot].has_value() && into[slot] != from[slot])
+			{
+				into[slot] = std::nullopt;
+				changed = true;
+			}
+		}
+		return changed;
+	};
+
+	return SolveForward(code, Constants(GetSlotCount(code)), transfer, meet);
+}
+
+std::vector<std::optional<Copies>> FindCopies(Bytecode& code)
+{
+	auto transfer = [&](int32_t at, Copies& copies) {
+		const auto& insn = code.code[at];
+		for (auto slot : GetWrites(code, insn))
+		{
+			copies[slot] = -1;
+			std::replace(copies.begin(), copies.end(), slot, -1);
+		}
+
+		// The source may itself be a copy, in which case both hold the original
+		if (insn.op == OpCode::Copy && insn.a != insn.c)
+			copies[insn.c] = (copies[insn.a] >= 0) ? copies[insn.a] : insn.a;
+		return GetSuccessors(insn, at);
+	};
+
+	auto meet = [](Copies& into, const Copies& from) {
+		bool changed = false;
+		for (size_t slot{}; slot < into.size(); slot++)
+		{
+			if (into[slot] >= 0 && into[slot] != from[slot])
+			{
+				into[slot] = -1;
+				changed = true;
+			}
+		}
+		return changed;
+	};
+
+	return SolveForward(code, Copies(GetSlotCount(code), -1), transfer, meet);
+}
+
+LiveSlots FindLiveSlots(Bytecode& code)
+{
+	auto slots = GetSlotCount(code);
+	LiveSlots live{ { code.code.size(), std::vector<bool>(slots) }, { code.code.size(), std::vector<bool>(slots) } };
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (auto at = static_cast<int32_t>(code.code.size()) - 1; at >= 0; at--)
+		{
+			const auto& insn = code.code[at];
+			std::vector<bool> out(slots);
+			if (insn.op == OpCode::Halt)
+			{
+				for (const auto& [name, slot] : code.globals)
+					out[slot] = true;
+			}
+			for (auto next : GetSuccessors(insn, at))
+			{
+				for (size_t slot{}; slot < slots; slot++)
+					out[slot] = out[slot] || live.in[next][slot];
+			}
+
+			auto in = out;
+			for (auto slot : GetWrites(code, insn))
+				in[slot] = false;
+			for (auto slot : GetReads(code, insn))
+				in[slot] = true;
+
+			changed = changed || in != live.in[at];
+			live.in[at] = std::move(in);
+			live.out[at] = std::move(out);
+		}
+	}
+	return live;
+}
+
+void Compact(Bytecode& code, const std::vector<bool>& removed)
+{
+	std::vector<int32_t> position(code.code.size() + 1);
+	int32_t next{};
+	for (size_t at{}; at < code.code.size(); at++)
+	{
+		position[at] = next;
+		if (!removed[at])
+			next++;
+	}
+	position.back() = next;
+
+	std::vector<Instruction> result{};
+	result.reserve(next);
+	for (size_t at{}; at < code.code.size(); at++)
+	{
+		if (removed[at])
+			continue;
+		auto insn = code.code[at];
+		if (HasTarget(insn.op))
+			insn.target = position[insn.target];
+		result.push_back(insn);
+	}
+
+	for (auto& function : code.functions)
+		function.entry = position[function.entry];
+	code.code = std::move(result);
+}
+
+}
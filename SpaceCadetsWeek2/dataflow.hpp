@@ -0,0 +1,58 @@
+#pragma once
+#include "common.hpp"
+#include "compiler.hpp"
+#include <span>
+
+namespace bbones {
+
+// Analyses of unfused bytecode shared by the passes of Optimize. Slots are
+// numbered per frame, so an analysis covers the top level and every
+// function body at once without them interfering.
+
+// Known value of each slot, None if it varies
+using Constants = std::vector<std::optional<int32_t>>;
+// Slot each slot currently holds a copy of, -1 if none
+using Copies = std::vector<int32_t>;
+
+struct LiveSlots {
+	std::vector<std::vector<bool>> in{};		// may be read from before each instruction on
+	std::vector<std::vector<bool>> out{};		// may be read from after each instruction on
+};
+
+bool HasTarget(OpCode op);
+std::vector<int32_t> GetSuccessors(const Instruction& insn, int32_t at);
+
+// Slots passed to a call or a loop idiom
+std::span<int32_t> GetOperands(Bytecode& code, const Instruction& insn);
+std::vector<int32_t> GetReads(Bytecode& code, const Instruction& insn);
+std::vector<int32_t> GetWrites(Bytecode& code, const Instruction& insn);
+
+// Arithmetic as the VM performs it, None where that would trap
+std::optional<int32_t> Fold(OpCode op, int32_t lhs, int32_t rhs);
+bool IsConditionTrue(Comparison cmp, int32_t value, int32_t literal);
+// What a While or If compares with given the values of slots, None if not known
+std::optional<int32_t> GetComparand(const Instruction& insn, const Constants& values);
+
+// Slots in the largest frame
+size_t GetSlotCount(const Bytecode& code);
+
+// Opening Function instruction of the body each instruction belongs to, -1
+// for the top level
+std::vector<int32_t> GetFrames(const Bytecode& code);
+
+// Values of slots before each instruction, None where it can never run.
+// Branches on constants only continue the way they go.
+std::vector<std::optional<Constants>> FindConstants(Bytecode& code);
+// Apply one instruction to `values`, returning where execution may continue
+std::vector<int32_t> TransferConstants(Bytecode& code, int32_t at, Constants& values);
+
+std::vector<std::optional<Copies>> FindCopies(Bytecode& code);
+
+// Top level variables are read once the program halts
+LiveSlots FindLiveSlots(Bytecode& code);
+
+// Drop the marked instructions. Jumps to one of them land on the next
+// instruction that is kept.
+void Compact(Bytecode& code, const std::vector<bool>& removed);
+
+}
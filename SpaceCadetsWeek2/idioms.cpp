@@ -0,0 +1,286 @@
+#include "idioms.hpp"
+
+namespace bbones {
+
+namespace {
+	// Loops over more variables than this are left alone
+	constexpr size_t max_variables = 16;
+
+	bool IsIdentityRow(const std::vector<uint32_t>& matrix, size_t dimension, size_t row)
+	{
+		for (size_t col = 0; col + 1 < dimension; col++)
+		{
+			if (matrix[row * dimension + col] != ((row == col) ? 1u : 0u))
+				return false;
+		}
+		return true;
+	}
+
+	// A loop only terminates predictably if its counter moves by one each iteration
+	std::optional<uint32_t> GetCounterStep(const std::vector<uint32_t>& matrix, size_t dimension, size_t counter)
+	{
+		auto step = matrix[counter * dimension + dimension - 1];
+		if (!IsIdentityRow(matrix, dimension, counter) || (step != 1u && step != static_cast<uint32_t>(-1)))
+			return std::nullopt;
+		return step;
+	}
+
+	// Numbers the variables of a candidate loop, then composes the effect of
+	// each statement of its body into the matrix of one iteration
+	class LoopBuilder {
+	private:
+		IProgram* m_program{};
+		const BlockTable& m_blocks;
+		std::vector<std::string> m_vars{};
+		std::unordered_map<std::string, size_t> m_indices{};
+
+		std::vector<std::string> GetWords(size_t ordinal)
+		{
+			return Tokenize(m_program->Fetch(ordinal).value()).ToStrings();
+		}
+
+		size_t Index(const std::string& name)
+		{
+			auto it = m_indices.find(name);
+			if (it != m_indices.end())
+				return it->second;
+
+			m_indices.insert({ name, m_vars.size() });
+			m_vars.push_back(name);
+			return m_vars.size() - 1;
+		}
+
+	public:
+		LoopBuilder(IProgram* program, const BlockTable& blocks)
+			: m_program{program}, m_blocks{blocks}
+		{
+		}
+
+		const std::vector<std::string>& GetVariables() const
+		{
+			return m_vars;
+		}
+
+		// while X not 0 do; with a body of nothing but affine statements and loops
+		bool Collect(size_t opener)
+		{
+			auto end = m_blocks.GetEnd(opener);
+			if (!end.has_value())
+				return false;
+			auto words = GetWords(opener);
+			if (words.size() < 4 || words[0] != "while" || words[2] != "not" || words[3] != "0")
+				return false;
+			Index(words[1]);
+
+			for (size_t ordinal = opener + 1; ordinal < end.value().GetOrdinal(); ordinal++)
+			{
+				words = GetWords(ordinal);
+				if (words.empty())
+					return false;
+
+				const auto& keyword = words[0];
+				if ((keyword == "incr" || keyword == "decr" || keyword == "clear") && words.size() >= 2)
+				{
+					Index(words[1]);
+				}
+				else if (keyword == "copy" && words.size() >= 4)
+				{
+					Index(words[1]);
+					Index(words[3]);
+				}
+				else if ((keyword == "add" || keyword == "sub") && words.size() >= 5)
+				{
+					Index(words[1]);
+					Index(words[2]);
+					Index(words[4]);
+				}
+				else if (keyword == "while" && Collect(ordinal))
+				{
+					ordinal = m_blocks.GetEnd(ordinal).value().GetOrdinal();
+				}
+				else
+				{
+					return false;
+				}
+			}
+			return m_vars.size() <= max_variables;
+		}
+
+		// Effect of one iteration of a loop that Collect has accepted
+		std::optional<std::vector<uint32_t>> Build(size_t opener)
+		{
+			const auto dimension = m_vars.size() + 1;
+			const auto constant = dimension - 1;
+
+			std::vector<uint32_t> matrix(dimension * dimension);
+			for (size_t i = 0; i < dimension; i++)
+				matrix[i * dimension + i] = 1;
+
+			auto row = [&](size_t index) { return matrix.begin() + index * dimension; };
+			auto combine = [&](size_t into, size_t lhs, size_t rhs, uint32_t rhs_factor) {
+				std::vector<uint32_t> result(dimension);
+				for (size_t col = 0; col < dimension; col++)
+					result[col] = row(lhs)[col] + rhs_factor * row(rhs)[col];
+				std::copy(result.begin(), result.end(), row(into));
+			};
+
+			auto end = m_blocks.GetEnd(opener).value().GetOrdinal();
+			for (size_t ordinal = opener + 1; ordinal < end; ordinal++)
+			{
+				auto words = GetWords(ordinal);
+				const auto& keyword = words[0];
+				if (keyword == "incr")
+				{
+					row(Index(words[1]))[constant] += 1;
+				}
+				else if (keyword == "decr")
+				{
+					row(Index(words[1]))[constant] -= 1;
+				}
+				else if (keyword == "clear")
+				{
+					std::fill(row(Index(words[1])), row(Index(words[1])) + dimension, 0u);
+				}
+				else if (keyword == "copy")
+				{
+					auto src = Index(words[1]);
+					std::copy(row(src), row(src) + dimension, row(Index(words[3])));
+				}
+				else if (keyword == "add" || keyword == "sub")
+				{
+					combine(Index(words[4]), Index(words[1]), Index(words[2]), (keyword == "add") ? 1u : static_cast<uint32_t>(-1));
+				}
+				else if (keyword == "while")
+				{
+					// Inner loops have to be linear in the state they start from: they
+					// may only add a constant to each variable per iteration
+					auto inner = Build(ordinal);
+					auto counter = Index(words[1]);
+					if (!inner.has_value())
+						return std::nullopt;
+					auto step = GetCounterStep(inner.value(), dimension, counter);
+					if (!step.has_value())
+						return std::nullopt;
+					for (size_t i = 0; i < m_vars.size(); i++)
+					{
+						if (!IsIdentityRow(inner.value(), dimension, i))
+							return std::nullopt;
+					}
+
+					// The inner loop runs -step * counter times and leaves the counter at 0
+					auto iterations = 0u - step.value();
+					for (size_t i = 0; i < m_vars.size(); i++)
+					{
+						if (i != counter)
+							combine(i, i, counter, inner.value()[i * dimension + constant] * iterations);
+					}
+					std::fill(row(counter), row(counter) + dimension, 0u);
+
+					ordinal = m_blocks.GetEnd(ordinal).value().GetOrdinal();
+				}
+			}
+			return matrix;
+		}
+	};
+}
+
+LoopSummary::LoopSummary(const std::vector<std::string>& vars, const std::vector<uint32_t>& body)
+	: m_vars{vars}, m_body{body}, m_translation{true}
+{
+	for (size_t i = 0; i < m_vars.size(); i++)
+		m_translation = m_translation && IsIdentityRow(m_body, GetDimension(), i);
+}
+
+size_t LoopSummary::GetDimension() const
+{
+	return m_vars.size() + 1;
+}
+
+LoopSummary::Matrix LoopSummary::Multiply(const Matrix& lhs, const Matrix& rhs) const
+{
+	auto dimension = GetDimension();
+	Matrix result(dimension * dimension);
+	for (size_t i = 0; i < dimension; i++)
+	{
+		for (size_t k = 0; k < dimension; k++)
+		{
+			auto factor = lhs[i * dimension + k];
+			if (factor == 0)
+				continue;
+			for (size_t j = 0; j < dimension; j++)
+				result[i * dimension + j] += factor * rhs[k * dimension + j];
+		}
+	}
+	return result;
+}
+
+const std::vector<std::string>& LoopSummary::GetVariables() const
+{
+	return m_vars;
+}
+
+bool LoopSummary::IsTranslation() const
+{
+	return m_translation;
+}
+
+uint32_t LoopSummary::GetIterations(int32_t counter) const
+{
+	auto step = m_body[GetDimension() - 1];
+	return (step == 1u) ? 0u - static_cast<uint32_t>(counter) : static_cast<uint32_t>(counter);
+}
+
+void LoopSummary::Apply(std::vector<int32_t>& values) const
+{
+	auto iterations = GetIterations(values[0]);
+	if (iterations == 0)
+		return;
+
+	auto dimension = GetDimension();
+	auto constant = dimension - 1;
+	if (m_translation)
+	{
+		for (size_t i = 0; i < m_vars.size(); i++)
+			values[i] = static_cast<int32_t>(static_cast<uint32_t>(values[i]) + m_body[i * dimension + constant] * iterations);
+		return;
+	}
+
+	// Raise the body to the number of iterations by repeated squaring
+	Matrix power(dimension * dimension);
+	for (size_t i = 0; i < dimension; i++)
+		power[i * dimension + i] = 1;
+	auto base = m_body;
+	for (auto n = iterations; n > 0; n >>= 1)
+	{
+		if (n & 1)
+			power = Multiply(base, power);
+		if (n > 1)
+			base = Multiply(base, base);
+	}
+
+	std::vector<int32_t> result(m_vars.size());
+	for (size_t i = 0; i < m_vars.size(); i++)
+	{
+		auto value = power[i * dimension + constant];
+		for (size_t j = 0; j < m_vars.size(); j++)
+			value += power[i * dimension + j] * static_cast<uint32_t>(values[j]);
+		result[i] = static_cast<int32_t>(value);
+	}
+	values = result;
+}
+
+std::optional<LoopSummary> SummariseLoop(IProgram* program, const BlockTable& blocks, const ExecutionCursor& opener)
+{
+	LoopBuilder builder{ program, blocks };
+	if (!builder.Collect(opener.GetOrdinal()))
+		return std::nullopt;
+
+	auto body = builder.Build(opener.GetOrdinal());
+	auto dimension = builder.GetVariables().size() + 1;
+	if (!body.has_value() || !GetCounterStep(body.value(), dimension, 0).has_value())
+		return std::nullopt;
+
+	return LoopSummary{ builder.GetVariables(), body.value() };
+}
+
+}
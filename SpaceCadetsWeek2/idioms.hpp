@@ -0,0 +1,43 @@
+#pragma once
+#include "common.hpp"
+#include "runtime.hpp"
+
+namespace bbones {
+
+// The effect of a "while X not 0 do" loop whose body only moves values around
+// with incr, decr, clear, copy, add and sub, and inner loops of the same kind.
+// This is how pure BareBones clears, adds and multiplies, at a cost of
+// O(value) steps. A summary applies the whole loop at once.
+//
+// Each of those statements is affine, so one iteration of the body is a
+// matrix over the loop's variables and running the loop n times is the nth
+// power of that matrix. Arithmetic wraps at 32 bits just as repeated incr and
+// decr do, so results are bit-identical to stepping through the loop.
+class LoopSummary {
+private:
+	using Matrix = std::vector<uint32_t>;
+
+	std::vector<std::string> m_vars{};		// m_vars[0] is the loop counter
+	Matrix m_body{};						// one iteration, row-major with the constant term in the last column
+	bool m_translation{};					// an iteration adds a constant to every variable
+
+	size_t GetDimension() const;
+	Matrix Multiply(const Matrix& lhs, const Matrix& rhs) const;
+
+public:
+	LoopSummary(const std::vector<std::string>& vars, const std::vector<uint32_t>& body);
+
+	const std::vector<std::string>& GetVariables() const;
+	bool IsTranslation() const;
+
+	// How many times the body runs when the loop is entered with this counter
+	uint32_t GetIterations(int32_t counter) const;
+
+	// Run the loop over the values of GetVariables(), in that order
+	void Apply(std::vector<int32_t>& values) const;
+};
+
+// None if the loop opened at the cursor is not one of the idioms above
+std::optional<LoopSummary> SummariseLoop(IProgram* program, const BlockTable& blocks, const ExecutionCursor& opener);
+
+}
@@ -0,0 +1,563 @@
+#include "jit.hpp"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace bbones {
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BBONES_JIT_X64
+#endif
+
+NativeRegion::NativeRegion(const std::vector<uint8_t>& machine_code)
+	: m_size{machine_code.size()}
+{
+	// Written while writable, then flipped to executable
+#ifdef _WIN32
+	m_memory = VirtualAlloc(nullptr, m_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (m_memory == nullptr)
+		return;
+	std::memcpy(m_memory, machine_code.data(), m_size);
+	DWORD old_protection{};
+	if (!VirtualProtect(m_memory, m_size, PAGE_EXECUTE_READ, &old_protection))
+	{
+		VirtualFree(m_memory, 0, MEM_RELEASE);
+		m_memory = nullptr;
+	}
+#else
+	m_memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (m_memory == MAP_FAILED)
+	{
+		m_memory = nullptr;
+		return;
+	}
+	std::memcpy(m_memory, machine_code.data(), m_size);
+	if (mprotect(m_memory, m_size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(m_memory, m_size);
+		m_memory = nullptr;
+	}
+#endif
+}
+
+NativeRegion::~NativeRegion()
+{
+	if (m_memory == nullptr)
+		return;
+#ifdef _WIN32
+	VirtualFree(m_memory, 0, MEM_RELEASE);
+#else
+	munmap(m_memory, m_size);
+#endif
+}
+
+bool NativeRegion::IsValid() const
+{
+	return m_memory != nullptr;
+}
+
+int32_t NativeRegion::Run(int32_t* slots, void* context) const
+{
+	using Entry = int32_t (*)(int32_t* slots, void* context);
+	return reinterpret_cast<Entry>(m_memory)(slots, context);
+}
+
+JitCompiler::JitCompiler(const Bytecode& code, const HostCalls& host)
+	: m_code{code}, m_host{host}
+{
+}
+
+bool JitCompiler::IsSupported()
+{
+#ifdef BBONES_JIT_X64
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifndef BBONES_JIT_X64
+
+std::unique_ptr<NativeRegion> JitCompiler::Compile(int32_t first, int32_t last) const
+{
+	return nullptr;
+}
+
+#else
+
+namespace {
+	enum Reg : uint8_t {
+		rax = 0, rcx = 1, rdx = 2, rbx = 3, rsp = 4, rbp = 5, rsi = 6, rdi = 7,
+		r8 = 8, r9 = 9, r12 = 12, r13 = 13, r14 = 14, r15 = 15,
+	};
+
+#ifdef _WIN32
+	constexpr Reg arg_regs[]{ rcx, rdx, r8 };
+#else
+	constexpr Reg arg_regs[]{ rdi, rsi, rdx };
+#endif
+
+	// Callee-saved on both ABIs, so host calls leave them alone
+	constexpr Reg cache_regs[]{ r12, r13, r14, r15 };
+
+	// rbx holds the frame, rbp the context. Both are saved along with the
+	// cache registers, and the stack is kept 16 byte aligned for host calls
+	// with room for the Windows shadow space.
+	constexpr Reg saved_regs[]{ rbx, rbp, r12, r13, r14, r15 };
+	constexpr int8_t frame_padding = 40;
+
+	// Condition codes of the jump taken when a condition is false
+	enum class Cond : uint8_t {
+		E = 0x4, NE = 0x5, L = 0xC, GE = 0xD, LE = 0xE, G = 0xF,
+	};
+
+	Cond GetFalseCond(Comparison cmp)
+	{
+		switch (cmp)
+		{
+		case Comparison::Is:	return Cond::NE;
+		case Comparison::Not:	return Cond::E;
+		case Comparison::Lt:	return Cond::GE;
+		case Comparison::Lte:	return Cond::G;
+		case Comparison::Gt:	return Cond::LE;
+		default:				return Cond::L;		// Gte
+		}
+	}
+
+	// A register, or a slot of the frame
+	struct Operand {
+		bool in_register{};
+		Reg reg{};
+		int32_t disp{};
+	};
+
+	Operand InReg(Reg reg)
+	{
+		return { true, reg };
+	}
+
+	class Assembler {
+	private:
+		std::vector<uint8_t> m_bytes{};
+
+	public:
+		const std::vector<uint8_t>& GetBytes() const { return m_bytes; }
+		size_t Here() const { return m_bytes.size(); }
+
+		void Byte(uint8_t value) { m_bytes.push_back(value); }
+
+		void Int32(int32_t value)
+		{
+			for (int i = 0; i < 4; i++)
+				Byte(static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * i)));
+		}
+
+		void Int64(uint64_t value)
+		{
+			for (int i = 0; i < 8; i++)
+				Byte(static_cast<uint8_t>(value >> (8 * i)));
+		}
+
+		void PatchRel32(size_t at, size_t target)
+		{
+			auto rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+			std::memcpy(m_bytes.data() + at, &rel, sizeof(rel));
+		}
+
+		// opcode /r with reg in ModRM.reg and rm in ModRM.rm
+		void RegRm(std::initializer_list<uint8_t> opcode, uint8_t reg, const Operand& rm, bool wide = false)
+		{
+			uint8_t rex = 0x40 | (wide ? 0x8 : 0) | ((reg & 8) ? 0x4 : 0) | ((rm.in_register && (rm.reg & 8)) ? 0x1 : 0);
+			if (rex != 0x40)
+				Byte(rex);
+			for (auto byte : opcode)
+				Byte(byte);
+
+			if (rm.in_register)
+			{
+				Byte(0xC0 | ((reg & 7) << 3) | (rm.reg & 7));
+			}
+			else
+			{
+				Byte(0x80 | ((reg & 7) << 3) | rbx);
+				Int32(rm.disp);
+			}
+		}
+
+		void Load(Reg dst, const Operand& src) { RegRm({ 0x8B }, dst, src); }
+		void Store(const Operand& dst, Reg src) { RegRm({ 0x89 }, src, dst); }
+		void MoveImm(const Operand& dst, int32_t imm) { RegRm({ 0xC7 }, 0, dst); Int32(imm); }
+		void AddImm(const Operand& dst, int32_t imm) { RegRm({ 0x81 }, 0, dst); Int32(imm); }
+		void CmpImm(const Operand& lhs, int32_t imm) { RegRm({ 0x81 }, 7, lhs); Int32(imm); }
+		void Cmp(Reg lhs, const Operand& rhs) { RegRm({ 0x3B }, lhs, rhs); }
+		void Add(Reg dst, const Operand& src) { RegRm({ 0x03 }, dst, src); }
+		void Sub(Reg dst, const Operand& src) { RegRm({ 0x2B }, dst, src); }
+		void Mul(Reg dst, const Operand& src) { RegRm({ 0x0F, 0xAF }, dst, src); }
+		void Test(Reg lhs, Reg rhs) { RegRm({ 0x85 }, rhs, InReg(lhs)); }
+		void Cdq() { Byte(0x99); }
+		void Idiv(const Operand& divisor) { RegRm({ 0xF7 }, 7, divisor); }
+		void Move64(Reg dst, Reg src) { RegRm({ 0x89 }, src, InReg(dst), true); }
+
+		void MoveImm64(Reg dst, uint64_t imm)
+		{
+			Byte(0x48 | ((dst & 8) ? 0x1 : 0));
+			Byte(0xB8 + (dst & 7));
+			Int64(imm);
+		}
+
+		void CallRax() { Byte(0xFF); Byte(0xD0); }
+		void Ret() { Byte(0xC3); }
+
+		void Push(Reg reg)
+		{
+			if (reg & 8)
+				Byte(0x41);
+			Byte(0x50 + (reg & 7));
+		}
+
+		void Pop(Reg reg)
+		{
+			if (reg & 8)
+				Byte(0x41);
+			Byte(0x58 + (reg & 7));
+		}
+
+		void AdjustStack(int8_t amount)
+		{
+			Byte(0x48);
+			Byte(0x83);
+			Byte(amount >= 0 ? 0xC4 : 0xEC);
+			Byte(static_cast<uint8_t>(amount >= 0 ? amount : -amount));
+		}
+
+		// Jumps return the offset of their displacement for patching
+		size_t Jump()
+		{
+			Byte(0xE9);
+			Int32(0);
+			return Here() - 4;
+		}
+
+		size_t JumpIf(Cond cond)
+		{
+			Byte(0x0F);
+			Byte(0x80 | static_cast<uint8_t>(cond));
+			Int32(0);
+			return Here() - 4;
+		}
+	};
+
+	// Slots an instruction reads or writes
+	std::vector<int32_t> GetSlots(const Bytecode& code, const Instruction& insn)
+	{
+		switch (insn.op)
+		{
+		case OpCode::Init:
+		case OpCode::Clear:
+		case OpCode::Incr:
+		case OpCode::Decr:
+		case OpCode::Print:
+		case OpCode::StepEndWhile:
+			return { insn.a };
+		case OpCode::Set:
+			return { insn.c };
+		case OpCode::Copy:
+			return { insn.a, insn.c };
+		case OpCode::Add:
+		case OpCode::Sub:
+		case OpCode::Mul:
+		case OpCode::Div:
+		case OpCode::Mod:
+		case OpCode::AddRotate:
+			return { insn.a, insn.b, insn.c };
+		case OpCode::CopyCopy:
+			return { insn.a, insn.b, insn.c, insn.target };
+		case OpCode::While:
+		case OpCode::If:
+			if (insn.cmp == Comparison::Always)
+				return {};
+			if (insn.slot_b)
+				return { insn.a, insn.b };
+			return { insn.a };
+		case OpCode::Loop:
+			return { code.operands.begin() + insn.b, code.operands.begin() + insn.b + insn.c };
+		default:
+			return {};
+		}
+	}
+
+	class RegionCompiler {
+	private:
+		const Bytecode& m_code;
+		const JitCompiler::HostCalls& m_host;
+		int32_t m_first{};
+		int32_t m_last{};
+
+		Assembler m_asm{};
+		std::unordered_map<int32_t, Reg> m_cached{};
+		std::vector<size_t> m_labels{};
+		std::vector<std::pair<size_t, int32_t>> m_jumps{};		// displacement, instruction jumped to
+		size_t m_epilogue{};
+
+		Operand Slot(int32_t slot) const
+		{
+			auto it = m_cached.find(slot);
+			if (it != m_cached.end())
+				return InReg(it->second);
+			return { false, rax, slot * static_cast<int32_t>(sizeof(int32_t)) };
+		}
+
+		bool IsInRegion(int32_t at) const
+		{
+			return at >= m_first && at <= m_last;
+		}
+
+		void JumpTo(int32_t at)
+		{
+			m_jumps.push_back({ m_asm.Jump(), at });
+		}
+
+		void JumpTo(Cond cond, int32_t at)
+		{
+			m_jumps.push_back({ m_asm.JumpIf(cond), at });
+		}
+
+		void Move(int32_t dst, int32_t src)
+		{
+			m_asm.Load(rax, Slot(src));
+			m_asm.Store(Slot(dst), rax);
+		}
+
+		void Compare(int32_t lhs, int32_t rhs)
+		{
+			m_asm.Load(rax, Slot(lhs));
+			m_asm.Cmp(rax, Slot(rhs));
+		}
+
+		void CacheSlots()
+		{
+			std::unordered_map<int32_t, size_t> uses{};
+			for (auto at = m_first; at <= m_last; at++)
+			{
+				for (auto slot : GetSlots(m_code, m_code.code[at]))
+					uses[slot] += 1;
+			}
+
+			std::vector<std::pair<size_t, int32_t>> ranked{};
+			for (auto [slot, count] : uses)
+				ranked.push_back({ count, slot });
+			std::sort(ranked.begin(), ranked.end(), std::greater<>{});
+
+			for (size_t i = 0; i < ranked.size() && i < std::size(cache_regs); i++)
+				m_cached.insert({ ranked[i].second, cache_regs[i] });
+		}
+
+		void LoadCached()
+		{
+			for (auto [slot, reg] : m_cached)
+				m_asm.Load(reg, { false, rax, slot * static_cast<int32_t>(sizeof(int32_t)) });
+		}
+
+		void SpillCached()
+		{
+			for (auto [slot, reg] : m_cached)
+				m_asm.Store({ false, rax, slot * static_cast<int32_t>(sizeof(int32_t)) }, reg);
+		}
+
+		void EmitPrologue()
+		{
+			for (auto reg : saved_regs)
+				m_asm.Push(reg);
+			m_asm.AdjustStack(-frame_padding);
+			m_asm.Move64(rbx, arg_regs[0]);
+			m_asm.Move64(rbp, arg_regs[1]);
+			LoadCached();
+		}
+
+		// Expects the instruction to resume the VM at in eax
+		void EmitEpilogue()
+		{
+			m_epilogue = m_asm.Here();
+			SpillCached();
+			m_asm.AdjustStack(frame_padding);
+			for (auto it = std::rbegin(saved_regs); it != std::rend(saved_regs); it++)
+				m_asm.Pop(*it);
+			m_asm.Ret();
+		}
+
+		void EmitHostCall(uint64_t function)
+		{
+			m_asm.MoveImm64(rax, function);
+			m_asm.CallRax();
+		}
+
+		void EmitInstruction(int32_t at)
+		{
+			const auto& insn = m_code.code[at];
+			switch (insn.op)
+			{
+			case OpCode::Init:
+			case OpCode::Clear:
+				m_asm.MoveImm(Slot(insn.a), 0);
+				break;
+			case OpCode::Set:
+				m_asm.MoveImm(Slot(insn.c), insn.b);
+				break;
+			case OpCode::Incr:
+				m_asm.AddImm(Slot(insn.a), 1);
+				break;
+			case OpCode::Decr:
+				m_asm.AddImm(Slot(insn.a), -1);
+				break;
+			case OpCode::Copy:
+				Move(insn.c, insn.a);
+				break;
+			case OpCode::Add:
+			case OpCode::Sub:
+			case OpCode::Mul:
+				m_asm.Load(rax, Slot(insn.a));
+				if (insn.op == OpCode::Add)
+					m_asm.Add(rax, Slot(insn.b));
+				else if (insn.op == OpCode::Sub)
+					m_asm.Sub(rax, Slot(insn.b));
+				else
+					m_asm.Mul(rax, Slot(insn.b));
+				m_asm.Store(Slot(insn.c), rax);
+				break;
+			case OpCode::Div:
+			case OpCode::Mod:
+				// Leave x / 0 and INT_MIN / -1 to the VM
+				m_asm.Load(rcx, Slot(insn.b));
+				m_asm.Test(rcx, rcx);
+				JumpTo(Cond::E, -1 - at);
+				m_asm.CmpImm(InReg(rcx), -1);
+				JumpTo(Cond::E, -1 - at);
+				m_asm.Load(rax, Slot(insn.a));
+				m_asm.Cdq();
+				m_asm.Idiv(InReg(rcx));
+				m_asm.Store(Slot(insn.c), (insn.op == OpCode::Div) ? rax : rdx);
+				break;
+			case OpCode::Print:
+				m_asm.Load(arg_regs[2], Slot(insn.a));
+				m_asm.MoveImm(InReg(arg_regs[1]), insn.b);
+				m_asm.Move64(arg_regs[0], rbp);
+				EmitHostCall(reinterpret_cast<uint64_t>(m_host.print));
+				break;
+			case OpCode::Loop:
+				SpillCached();
+				m_asm.Move64(arg_regs[2], rbx);
+				m_asm.MoveImm(InReg(arg_regs[1]), at);
+				m_asm.Move64(arg_regs[0], rbp);
+				EmitHostCall(reinterpret_cast<uint64_t>(m_host.loop));
+				LoadCached();
+				break;
+			case OpCode::While:
+			case OpCode::If:
+				if (insn.cmp == Comparison::Always)
+					break;
+				if (insn.slot_b)
+					Compare(insn.a, insn.b);
+				else
+					m_asm.CmpImm(Slot(insn.a), insn.b);
+				JumpTo(GetFalseCond(insn.cmp), insn.target);
+				break;
+			case OpCode::Else:
+			case OpCode::End:
+			case OpCode::Function:
+			case OpCode::EndWhile:
+				JumpTo(insn.target);
+				break;
+			case OpCode::StepEndWhile:
+				m_asm.AddImm(Slot(insn.a), insn.b);
+				JumpTo(insn.target);
+				break;
+			case OpCode::CopyCopy:
+				Move(insn.c, insn.a);
+				Move(insn.target, insn.b);
+				JumpTo(at + 2);
+				break;
+			case OpCode::AddRotate:
+				m_asm.Load(rax, Slot(insn.a));
+				m_asm.Add(rax, Slot(insn.b));
+				m_asm.Store(Slot(insn.c), rax);
+				Move(insn.a, insn.b);
+				Move(insn.b, insn.c);
+				JumpTo(at + 3);
+				break;
+			default:
+				// Calls, returns, faults and halts are the VM's job
+				JumpTo(-1 - at);
+				break;
+			}
+		}
+
+		// Jumps out of the region, or to an instruction the VM has to run
+		// (encoded as -1 - index), go through a stub that sets the resume point
+		// and then jumps on to the epilogue
+		std::vector<size_t> EmitExits()
+		{
+			std::unordered_map<int32_t, size_t> stubs{};
+			std::vector<size_t> to_epilogue{};
+			for (auto [displacement, target] : m_jumps)
+			{
+				if (target >= 0 && IsInRegion(target))
+				{
+					m_asm.PatchRel32(displacement, m_labels[target - m_first]);
+					continue;
+				}
+
+				auto resume = (target >= 0) ? target : -1 - target;
+				if (!stubs.contains(resume))
+				{
+					stubs.insert({ resume, m_asm.Here() });
+					m_asm.MoveImm(InReg(rax), resume);
+					to_epilogue.push_back(m_asm.Jump());
+				}
+				m_asm.PatchRel32(displacement, stubs.at(resume));
+			}
+			return to_epilogue;
+		}
+
+	public:
+		RegionCompiler(const Bytecode& code, const JitCompiler::HostCalls& host, int32_t first, int32_t last)
+			: m_code{code}, m_host{host}, m_first{first}, m_last{last}
+		{
+		}
+
+		std::vector<uint8_t> Compile()
+		{
+			CacheSlots();
+			EmitPrologue();
+			for (auto at = m_first; at <= m_last; at++)
+			{
+				m_labels.push_back(m_asm.Here());
+				EmitInstruction(at);
+			}
+			JumpTo(m_last + 1);
+
+			auto to_epilogue = EmitExits();
+			EmitEpilogue();
+			for (auto displacement : to_epilogue)
+				m_asm.PatchRel32(displacement, m_epilogue);
+
+			return m_asm.GetBytes();
+		}
+	};
+}
+
+std::unique_ptr<NativeRegion> JitCompiler::Compile(int32_t first, int32_t last) const
+{
+	auto region = std::make_unique<NativeRegion>(RegionCompiler{ m_code, m_host, first, last }.Compile());
+	if (!region->IsValid())
+		return nullptr;
+	return region;
+}
+
+#endif
+
+}
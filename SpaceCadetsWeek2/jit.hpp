@@ -0,0 +1,53 @@
+#pragma once
+#include "common.hpp"
+#include "compiler.hpp"
+
+namespace bbones {
+
+// Machine code for a region of bytecode, in memory of its own. Running it
+// executes the region and returns the index of the instruction the VM
+// should continue from.
+class NativeRegion {
+private:
+	void* m_memory{};
+	size_t m_size{};
+
+public:
+	NativeRegion(const std::vector<uint8_t>& machine_code);
+	~NativeRegion();
+	NativeRegion(const NativeRegion&) = delete;
+	NativeRegion& operator=(const NativeRegion&) = delete;
+
+	bool IsValid() const;
+	int32_t Run(int32_t* slots, void* context) const;
+};
+
+// Compiles a contiguous range of bytecode (a while loop or a function body)
+// into x86-64 machine code. Slots are addressed off the frame passed to
+// NativeRegion::Run, the most used of them are kept in registers.
+//
+// Instructions that need the VM (calls, returns, faults, and divisions the
+// CPU would trap on) leave native code and resume the VM at that
+// instruction. print and loop idioms are host calls, which are passed the
+// context given to Run.
+class JitCompiler {
+public:
+	struct HostCalls {
+		void (*print)(void* context, int32_t name, int32_t value){};
+		void (*loop)(void* context, int32_t at, int32_t* slots){};
+	};
+
+private:
+	const Bytecode& m_code;
+	HostCalls m_host{};
+
+public:
+	JitCompiler(const Bytecode& code, const HostCalls& host);
+
+	// Null if this machine cannot run the generated code
+	std::unique_ptr<NativeRegion> Compile(int32_t first, int32_t last) const;
+
+	static bool IsSupported();
+};
+
+}
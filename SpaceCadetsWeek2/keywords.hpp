@@ -0,0 +1,103 @@
+#pragma once
+#include "common.hpp"
+#include <array>
+#include <string_view>
+
+namespace bbones {
+
+// The statements built into the language. Their keywords are resolved with
+// a perfect hash chosen at compile time, so recognising one costs a
+// multiply and a single string compare.
+enum class Keyword : uint8_t {
+	Init,
+	Incr,
+	Decr,
+	Clear,
+	While,
+	Copy,
+	End,
+	If,
+	Elif,
+	Else,
+	Print,
+	Add,
+	Sub,
+	Mul,
+	Div,
+	Mod,
+	Set,
+	Function,
+};
+
+inline constexpr std::array<std::string_view, 18> keyword_names{
+	"init", "incr", "decr", "clear", "while", "copy", "end", "if", "elif", "else",
+	"print", "add", "sub", "mul", "div", "mod", "set", "function",
+};
+
+inline constexpr size_t keyword_count = keyword_names.size();
+
+namespace detail {
+	inline constexpr size_t keyword_slot_bits = 5;
+	inline constexpr uint8_t no_keyword = 0xFF;
+
+	// The length and the first and last letters already tell the keywords
+	// apart; the seed spreads them over the slots without collisions.
+	constexpr size_t HashKeyword(std::string_view word, uint32_t seed)
+	{
+		auto first = static_cast<uint32_t>(static_cast<uint8_t>(word.front()));
+		auto last = static_cast<uint32_t>(static_cast<uint8_t>(word.back()));
+		auto key = first | (last << 8) | (static_cast<uint32_t>(word.size()) << 16);
+		auto mixed = key * seed;
+		return (mixed ^ (mixed >> 16)) & ((1 << keyword_slot_bits) - 1);
+	}
+
+	constexpr uint32_t FindKeywordSeed()
+	{
+		for (uint32_t seed = 1; seed < 1'000'000; seed += 2)
+		{
+			std::array<bool, (1 << keyword_slot_bits)> used{};
+			bool collides = false;
+			for (auto name : keyword_names)
+			{
+				auto slot = HashKeyword(name, seed);
+				collides = collides || used[slot];
+				used[slot] = true;
+			}
+			if (!collides)
+				return seed;
+		}
+		return 0;
+	}
+
+	inline constexpr uint32_t keyword_seed = FindKeywordSeed();
+	static_assert(keyword_seed != 0, "no perfect hash found for the keywords");
+
+	constexpr std::array<uint8_t, (1 << keyword_slot_bits)> BuildKeywordTable()
+	{
+		std::array<uint8_t, (1 << keyword_slot_bits)> table{};
+		table.fill(no_keyword);
+		for (size_t i = 0; i < keyword_count; i++)
+			table[HashKeyword(keyword_names[i], keyword_seed)] = static_cast<uint8_t>(i);
+		return table;
+	}
+
+	inline constexpr auto keyword_table = BuildKeywordTable();
+}
+
+constexpr std::optional<Keyword> FindKeyword(std::string_view word)
+{
+	if (word.empty())
+		return std::nullopt;
+
+	auto index = detail::keyword_table[detail::HashKeyword(word, detail::keyword_seed)];
+	if (index == detail::no_keyword || keyword_names[index] != word)
+		return std::nullopt;
+	return static_cast<Keyword>(index);
+}
+
+constexpr std::string_view GetKeywordName(Keyword keyword)
+{
+	return keyword_names[static_cast<size_t>(keyword)];
+}
+
+}
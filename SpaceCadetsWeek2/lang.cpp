@@ -1,4 +1,5 @@
 #include "lang.hpp"
+#include "parallel.hpp"
 #include <iostream>
 
 namespace bbones {
@@ -10,15 +11,15 @@ namespace macros {
 	}
 	
 	// Throws runtime error on failure
-	Variable* GetVariable(BareBones& machine, const std::string& name)
+	Variable* GetVariable(BareBones& machine, std::string_view name)
 	{
 		auto var_opt = GetScope(machine)->GetVariable(name);
 		if (!var_opt.has_value())
-			throw std::runtime_error("Error: tried to access variable \"" + name + "\" when it does not exist!");
+			throw std::runtime_error("Error: tried to access variable \"" + std::string{ name } + "\" when it does not exist!");
 		return var_opt.value();
 	}
 
-	bool DoesVariableExist(BareBones& machine, const std::string& name)
+	bool DoesVariableExist(BareBones& machine, std::string_view name)
 	{
 		return machine.GetExecutionState().GetScope()->GetVariable(name).has_value();
 	}
@@ -33,37 +34,243 @@ namespace macros {
 		machine.GetExecutionState().PopScope();
 	}
 
-	bool IsConditionTrue(
-		BareBones& machine,
-		const std::string& var_name,
-		const std::string& operation,
-		const std::string& comparison 
-	)
+	// Throws runtime error if the block opened at the cursor has no end
+	ExecutionCursor GetEnd(BareBones& machine, const ExecutionCursor& opener)
 	{
-		static auto op_is = [](Variable* var, int comparison) -> bool { return var->GetValue() == comparison; };
-		static auto op_not = [](Variable* var, int comparison) -> bool { return var->GetValue() != comparison; };
-		static auto op_lt = [](Variable* var, int comparison) -> bool{ return var->GetValue() < comparison; };
-		static auto op_lte = [](Variable* var, int comparison) -> bool { return var->GetValue() <= comparison; };
-		static auto op_gt = [](Variable* var, int comparison) -> bool { return var->GetValue() > comparison; };
-		static auto op_gte = [](Variable* var, int comparison) -> bool { return var->GetValue() >= comparison; };
-		static std::unordered_map <std::string, std::function<bool(Variable*, int)>> ops{
-			{"is", op_is},
-			{"not", op_not},
-			{"<", op_lt},
-			{"<=", op_lte},
-			{">", op_gt},
-			{">=", op_gte}
-		};
-
-		auto* var = GetVariable(machine, var_name);
-		auto op = ops[operation];
-		auto comparison_val = std::stoi(comparison);
-		return op(var, comparison_val);
-	}
-}
-
-BareBonesBuilder::BareBonesBuilder(Parser parser, std::shared_ptr<ExecutionState> state, IProgram* program)
-	: m_proto{parser, state, program}
+		auto end = machine.GetBlockTable().GetEnd(opener);
+		if (!end.has_value())
+			throw std::runtime_error("Error: missing end statement.");
+		return end.value();
+	}
+
+	ExecutionCursor After(const ExecutionCursor& cursor)
+	{
+		return ExecutionCursor{ cursor.GetOrdinal() + 1 };
+	}
+
+	// Arithmetic wraps around, as it does in the virtual machine
+	int Add(int lhs, int rhs)
+	{
+		return static_cast<int>(static_cast<uint32_t>(lhs) + static_cast<uint32_t>(rhs));
+	}
+
+	int Sub(int lhs, int rhs)
+	{
+		return static_cast<int>(static_cast<uint32_t>(lhs) - static_cast<uint32_t>(rhs));
+	}
+
+	int Mul(int lhs, int rhs)
+	{
+		return static_cast<int>(static_cast<uint32_t>(lhs) * static_cast<uint32_t>(rhs));
+	}
+
+	template <typename T>
+	bool IsMappedTo(Parser& parser, const std::string& keyword)
+	{
+		return dynamic_cast<T*>(parser.GetStatementFor(keyword).value_or(nullptr)) != nullptr;
+	}
+
+	template <typename... Ts>
+	bool IsAnyOf(IStatement* statement)
+	{
+		return ((dynamic_cast<Ts*>(statement) != nullptr) || ...);
+	}
+
+	bool IsConditionTrue(BareBones& machine, Condition& condition)
+	{
+		if (condition.cmp == Comparison::Always)
+			return true;
+
+		auto serial = GetScope(machine)->GetSerial();
+		if (condition.resolved_in != serial)
+		{
+			condition.lhs_var = GetVariable(machine, condition.lhs);
+			condition.rhs_var = condition.rhs.empty() ? nullptr : GetVariable(machine, condition.rhs);
+			condition.resolved_in = serial;
+		}
+
+		auto lhs = condition.lhs_var->GetValue();
+		auto rhs = (condition.rhs_var == nullptr) ? condition.literal : condition.rhs_var->GetValue();
+		switch (condition.cmp)
+		{
+		case Comparison::Is:	return lhs == rhs;
+		case Comparison::Not:	return lhs != rhs;
+		case Comparison::Lt:	return lhs < rhs;
+		case Comparison::Lte:	return lhs <= rhs;
+		case Comparison::Gt:	return lhs > rhs;
+		default:				return lhs >= rhs;		// Gte
+		}
+	}
+}
+
+std::optional<Comparison> DecodeComparison(std::string_view operation)
+{
+	static const StringMap<Comparison> comparisons{
+		{"is", Comparison::Is},
+		{"not", Comparison::Not},
+		{"<", Comparison::Lt},
+		{"<=", Comparison::Lte},
+		{">", Comparison::Gt},
+		{">=", Comparison::Gte}
+	};
+
+	auto it = comparisons.find(operation);
+	if (it == comparisons.end())
+		return std::nullopt;
+	return it->second;
+}
+
+ProgramContext::ProgramContext(const Parser& parser, IProgram* program, std::vector<VariableAccess> accesses)
+	: m_parser{parser}, m_program{program}, m_blocks{program}, m_accesses{std::move(accesses)}
+{
+	m_decoded.resize(m_blocks.GetStatementCount());
+	if (HasBuiltinLoopStatements())
+		SummariseLoops();
+	DecodeAll();
+}
+
+// Loop idioms are only recognised by keyword, so the keywords have to mean what they usually do
+bool ProgramContext::HasBuiltinLoopStatements()
+{
+	return macros::IsMappedTo<WhileStatement>(m_parser, "while") && macros::IsMappedTo<EndStatement>(m_parser, "end")
+		&& macros::IsMappedTo<IncrementStatement>(m_parser, "incr") && macros::IsMappedTo<DecrementStatement>(m_parser, "decr")
+		&& macros::IsMappedTo<ClearStatement>(m_parser, "clear") && macros::IsMappedTo<CopyStatement>(m_parser, "copy")
+		&& macros::IsMappedTo<AddStatement>(m_parser, "add") && macros::IsMappedTo<SubStatement>(m_parser, "sub");
+}
+
+// Each loop is summarised on its own, so the openers are split across threads
+// and the summaries merged afterwards
+void ProgramContext::SummariseLoops()
+{
+	auto chunks = GetParallelChunks(m_blocks.GetStatementCount(), 1 << 14);
+	std::vector<std::vector<std::pair<size_t, LoopSummary>>> found(chunks);
+	ParallelFor(chunks, m_blocks.GetStatementCount(), [&](size_t chunk, size_t begin, size_t end) {
+		for (size_t ordinal = begin; ordinal < end; ordinal++)
+		{
+			auto summary = SummariseLoop(m_program, m_blocks, ordinal);
+			if (summary.has_value())
+				found[chunk].emplace_back(ordinal, std::move(summary.value()));
+		}
+	});
+
+	for (auto& summaries : found)
+	{
+		for (auto& [ordinal, summary] : summaries)
+			m_loops.insert({ ordinal, std::move(summary) });
+	}
+}
+
+Parser& ProgramContext::GetParser()
+{
+	return m_parser;
+}
+
+IProgram* ProgramContext::GetProgram()
+{
+	return m_program;
+}
+
+const BlockTable& ProgramContext::GetBlockTable() const
+{
+	return m_blocks;
+}
+
+// Fetch and parse the statement at ip the first time it is reached. Returns
+// nullptr past the end of the program. Statements are only cached once they
+// parse, so calls to functions defined later are still picked up.
+const Parser::ParserResult* ProgramContext::Decode(const ExecutionCursor& ip)
+{
+	if (ip.GetOrdinal() >= m_decoded.size())
+		return nullptr;
+
+	auto& decoded = m_decoded[ip.GetOrdinal()];
+	if (!decoded.has_value())
+	{
+		decoded = DecodeStatement(ip);
+		if (!decoded.has_value())
+			throw std::runtime_error{ "BareBones: instruction " + std::string{ m_program->Fetch(ip).value() } + " is not recognised!" };
+	}
+	return &decoded.value();
+}
+
+std::optional<Parser::ParserResult> ProgramContext::DecodeStatement(const ExecutionCursor& ip) const
+{
+	auto decoded = m_parser.Parse(m_program->Fetch(ip).value());
+	static LoopIdiomStatement loop_idiom{};
+	if (decoded.has_value() && m_loops.contains(ip.GetOrdinal()))
+		decoded.value().statement = &loop_idiom;
+	return decoded;
+}
+
+// Statements parse independently of each other, so a large program is
+// decoded across threads up front instead of a statement at a time as it
+// first runs. Calls to functions that are not defined yet are left to Decode.
+void ProgramContext::DecodeAll()
+{
+	auto chunks = GetParallelChunks(m_decoded.size(), 1 << 14);
+	if (chunks == 1)
+		return;
+
+	ParallelFor(chunks, m_decoded.size(), [&](size_t, size_t begin, size_t end) {
+		for (size_t ordinal = begin; ordinal < end; ordinal++)
+			m_decoded[ordinal] = DecodeStatement(ordinal);
+	});
+}
+
+const LoopSummary* ProgramContext::GetLoopSummary(const ExecutionCursor& opener) const
+{
+	auto it = m_loops.find(opener.GetOrdinal());
+	if (it == m_loops.end())
+		return nullptr;
+	return &it->second;
+}
+
+// Decoded once rather than on every test, which is every iteration of a
+// while. Conditions that fail to decode are not cached, so they fail each time.
+Condition& ProgramContext::DecodeCondition(const ExecutionCursor& ip, std::string_view keyword, const Tokens& args)
+{
+	auto it = m_conditions.find(ip.GetOrdinal());
+	if (it != m_conditions.end())
+		return it->second;
+
+	if (keyword == "else")
+		return m_conditions[ip.GetOrdinal()];
+	if (args.size() < 3)
+		throw std::runtime_error("Error: malformed condition in \"" + std::string{ keyword } + "\" statement.");
+
+	auto cmp = DecodeComparison(args[1]);
+	if (!cmp.has_value())
+		throw std::runtime_error("Error: unknown comparison \"" + std::string{ args[1] } + "\".");
+
+	Condition decoded{ cmp.value(), std::string{ args[0] } };
+	try {
+		decoded.literal = std::stoi(std::string{ args[2] });
+	}
+	catch (const std::exception&) {
+		decoded.rhs = std::string{ args[2] };
+	}
+	return m_conditions.insert({ ip.GetOrdinal(), std::move(decoded) }).first->second;
+}
+
+VariableAccess ProgramContext::GetVariableAccess(const ExecutionCursor& ip) const
+{
+	if (ip.GetOrdinal() >= m_accesses.size())
+		return VariableAccess::Unchecked;
+	return m_accesses[ip.GetOrdinal()];
+}
+
+bool ProgramContext::IsMemoizing() const
+{
+	return m_memoize;
+}
+
+void ProgramContext::SetMemoizing(bool enabled)
+{
+	m_memoize = enabled;
+}
+
+BareBonesBuilder::BareBonesBuilder(std::shared_ptr<ProgramContext> context, std::shared_ptr<ExecutionState> state)
+	: m_proto{context, state}
 {}
 
 BareBonesBuilder& BareBonesBuilder::NonExecutable()
@@ -84,7 +291,7 @@ BareBonesBuilder& BareBonesBuilder::WithNewBaseScope()
 
 BareBones BareBonesBuilder::Finish()
 {
-	return BareBones{ m_proto.parser, m_proto.cpu, m_proto.program, m_nx };
+	return BareBones{ m_proto.context, m_proto.cpu, m_nx };
 }
 
 bool BareBones::DoExecution()
@@ -92,36 +299,63 @@ bool BareBones::DoExecution()
 	return !m_nx;
 }
 
-std::optional<BareBonesStep> BareBones::Step()
+bool BareBones::Step()
 {
-	auto rip = GetExecutionState().GetCursor();
-	auto stack_depth_before = GetExecutionState().GetScope()->GetDepth();
-	auto insn_str = m_program->Fetch(rip);
-	if (!insn_str.has_value())
+	auto& state = GetExecutionState();
+	auto rip = state.GetCursor();
+
+	// Reaching the end of the innermost block hands control back to whatever entered it
+	auto* frame = state.GetControlFrame();
+	if (frame != nullptr && frame->end.GetOrdinal() == rip.GetOrdinal())
 	{
-		Finish();
-		return std::nullopt;
+		state.LeaveBlock();
+		return true;
 	}
 
-	auto insn_and_args = m_parser.Parse(insn_str.value());
-	GetExecutionState().IncrementCursor();
-	auto parse_result = insn_and_args.value();
-	auto insn = parse_result.statement;
-	auto args = parse_result.args;
+	const auto* parse_result = Decode(rip);
+	if (parse_result == nullptr)
+	{
+		Finish();
+		return false;
+	}
 
-	if (!insn_and_args.has_value())
-		throw std::runtime_error{ "BareBones: instruction " + insn_str.value() + " is not recognised!" };
+	state.IncrementCursor();
 	if (DoExecution())
-		insn->Execute(*this, rip, args);
+		parse_result->statement->Execute(*this, rip, parse_result->args);
 	else
-		insn->Skip(*this, rip, args);
+		parse_result->statement->Skip(*this, rip, parse_result->args);
+	return true;
+}
+
+std::optional<BareBonesStep> BareBones::TraceStep()
+{
+	auto& state = GetExecutionState();
+	BareBonesStep step{};
+	step.ip_before = state.GetCursor();
+	step.stack_depth_before = state.GetStackDepth();
+
+	// Recorded up front, as the statement may leave the block it is in
+	auto* frame = state.GetControlFrame();
+	if (frame != nullptr && frame->end.GetOrdinal() == step.ip_before.GetOrdinal())
+	{
+		auto terminator = GetProgram()->Fetch(step.ip_before).value();
+		step.statement_name = std::string{ FirstWord(terminator) };
+	}
+	else if (const auto* parse_result = Decode(step.ip_before))
+	{
+		step.statement_name = std::string{ parse_result->statement_name };
+		step.args = parse_result->args.ToStrings();
+	}
+
+	if (!Step())
+		return std::nullopt;
 
-	auto rip_after = GetExecutionState().GetCursor();
-	auto stack_depth_after = GetExecutionState().GetScope()->GetDepth();
-	return {{ parse_result.statement_name, args, rip, rip_after, stack_depth_before, stack_depth_after }};
+	step.ip_after = state.GetCursor();
+	step.stack_depth_after = state.GetStackDepth();
+	return step;
 }
 
-void NoopStatement::Execute(BareBones& machine, const ExecutionCursor& cursor,const std::vector<std::string>& args)
+void NoopStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 }
 
@@ -137,15 +371,15 @@ bool BareBones::IsFinished()
 
 BareBonesBuilder BareBones::BuildAlias()
 {
-	return BareBonesBuilder{ m_parser, m_cpu, m_program };
+	return BareBonesBuilder{ m_context, m_cpu };
 }
 
 BareBonesBuilder BareBones::BuildCopy()
 {
 	// Changes made to exec state will not be reflected in the parent instance
-	// since we are making a copy here.
+	// since we are making a copy here. Neither will functions the copy defines.
 	std::shared_ptr<ExecutionState> exec_state = std::shared_ptr<ExecutionState>{ new ExecutionState{GetExecutionState().DeepCopy()}};
-	return BareBonesBuilder{ m_parser, exec_state, m_program };
+	return BareBonesBuilder{ std::make_shared<ProgramContext>(*m_context), exec_state };
 }
 
 void BareBones::PrintState()
@@ -153,14 +387,15 @@ void BareBones::PrintState()
 	std::cout << ((m_nx) ? "Execution disabled. " : "") << m_cpu->GetStateString() << '\n';
 }
 
-BareBones BareBones::Create(const Parser& parser, IProgram* program)
+BareBones BareBones::Create(const Parser& parser, IProgram* program, std::vector<VariableAccess> accesses)
 {
 	auto ptr_state = std::shared_ptr<ExecutionState>{ new ExecutionState{} };
-	return BareBones{parser, ptr_state, program, false};
+	auto context = std::make_shared<ProgramContext>(parser, program, std::move(accesses));
+	return BareBones{context, ptr_state, false};
 }
 
-BareBones::BareBones(const Parser& parser, std::shared_ptr<ExecutionState> state, IProgram* program, bool nx)
-	: m_parser{ parser }, m_program{ program }, m_cpu{ state }, m_nx{nx}
+BareBones::BareBones(std::shared_ptr<ProgramContext> context, std::shared_ptr<ExecutionState> state, bool nx)
+	: m_context{ context }, m_cpu{ state }, m_nx{nx}
 {
 }
 
@@ -171,7 +406,47 @@ ExecutionState& BareBones::GetExecutionState()
 
 Parser& BareBones::GetParser()
 {
-	return m_parser;
+	return m_context->GetParser();
+}
+
+const BlockTable& BareBones::GetBlockTable() const
+{
+	return m_context->GetBlockTable();
+}
+
+IProgram* BareBones::GetProgram()
+{
+	return m_context->GetProgram();
+}
+
+const Parser::ParserResult* BareBones::Decode(const ExecutionCursor& ip)
+{
+	return m_context->Decode(ip);
+}
+
+const LoopSummary* BareBones::GetLoopSummary(const ExecutionCursor& opener) const
+{
+	return m_context->GetLoopSummary(opener);
+}
+
+Condition& BareBones::DecodeCondition(const ExecutionCursor& ip, std::string_view keyword, const Tokens& args)
+{
+	return m_context->DecodeCondition(ip, keyword, args);
+}
+
+VariableAccess BareBones::GetVariableAccess(const ExecutionCursor& ip) const
+{
+	return m_context->GetVariableAccess(ip);
+}
+
+bool BareBones::IsMemoizing() const
+{
+	return m_context->IsMemoizing();
+}
+
+void BareBones::SetMemoizing(bool enabled)
+{
+	m_context->SetMemoizing(enabled);
 }
 
 void BareBones::Execute()
@@ -196,38 +471,50 @@ Parser ParserBuilder::Finish()
 	return tmp;
 }
 
-std::optional<IStatement*> Parser::GetStatementFor(const std::string& keyword)
+std::optional<IStatement*> Parser::GetStatementFor(std::string_view keyword) const
 {
-	if (m_mappings.find(keyword) == m_mappings.end())
+	// Built in keywords never reach the map
+	auto builtin = FindKeyword(keyword);
+	if (builtin.has_value())
+		return GetStatementFor(builtin.value());
+
+	auto it = m_mappings.find(keyword);
+	if (it == m_mappings.end())
 		return std::nullopt;
 
-	return std::optional<IStatement*>(m_mappings.at(keyword));
+	return it->second;
 }
 
-std::vector<std::string> Parser::ParseArgs(int after_pos, const std::string& statement)
+Tokens Parser::ParseArgs(size_t after_pos, std::string_view statement) const
 {
-	std::vector<std::string> result{};
-	int l = after_pos;
-	int r = after_pos;
-	for (; r < statement.size(); r++)
-	{
-		if (statement[r] == ' ')
-		{
-			if (r != l)
-				result.push_back(statement.substr(l, (r - l)));
+	if (after_pos >= statement.size())
+		return {};
 
-			l = r + 1;
-		}
-	}
-	if (l < r && l < statement.size() && r <= statement.size())
-		result.push_back(statement.substr(l, r - l));
+	return Tokenize(statement.substr(after_pos));
+}
+
+std::optional<IStatement*> Parser::GetStatementFor(Keyword keyword) const
+{
+	auto* statement = m_keywords[static_cast<size_t>(keyword)];
+	if (statement == nullptr)
+		return std::nullopt;
 
-	return result;
+	return statement;
 }
 
+// The first mapping of a name wins
 void Parser::AddMapping(const std::string& keyword, IStatement* statement)
 {
-	m_mappings.insert({ keyword, statement });//std::make_shared<IStatement>(statement) });
+	auto builtin = FindKeyword(keyword);
+	if (!builtin.has_value())
+	{
+		m_mappings.insert({ keyword, statement });//std::make_shared<IStatement>(statement) });
+		return;
+	}
+
+	auto& slot = m_keywords[static_cast<size_t>(builtin.value())];
+	if (slot == nullptr)
+		slot = statement;
 }
 
 ParserBuilder Parser::Builder()
@@ -235,57 +522,41 @@ ParserBuilder Parser::Builder()
 	return ParserBuilder();
 }
 
-std::optional<Parser::ParserResult> Parser::Parse(const std::string& statement)
+std::optional<Parser::ParserResult> Parser::Parse(std::string_view statement) const
 {
-	// Find the first word of the statement
-	std::string first_word{};
-	int r = 0;
-
-	// Skip leading whitespace
-	while (statement[r] == ' ')
-		r += 1;
-	for (; r < statement.size(); r++)
-	{
-		if (statement[r] == ' ' && r > 0)
-		{
-			first_word = statement.substr(0, r);
-			break;
-		}
-	}
-
-	if (first_word.empty())
-		first_word = statement;
-
-	auto insn_statement = GetStatementFor(first_word);
+	// The keyword is looked up in place, so nothing is allocated for a
+	// statement that is not recognised
+	auto words = Tokenize(statement);
+	auto keyword = words.empty() ? statement : words[0];
+	auto insn_statement = GetStatementFor(keyword);
 	if (!insn_statement.has_value())
 		return std::nullopt;
 
-	auto args = ParseArgs(r+1, statement);
-	return {{ first_word, insn_statement.value(), args }};
+	return {{ keyword, insn_statement.value(), words.From(1) }};
 }
 
-void ClearStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void ClearStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto target_name = args[0];
 	auto* var = macros::GetVariable(machine, target_name);
 	var->SetValue(0);
 }
 
-void IncrementStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void IncrementStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto target_name = args[0];
 	auto* var = macros::GetVariable(machine, target_name);
-	var->SetValue(var->GetValue() + 1);
+	var->SetValue(macros::Add(var->GetValue(), 1));
 }
 
-void DecrementStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void DecrementStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto target_name = args[0];
 	auto* var = macros::GetVariable(machine, target_name);
-	var->SetValue(var->GetValue() - 1);
+	var->SetValue(macros::Sub(var->GetValue(), 1));
 }
 
-void CopyStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void CopyStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto src_name = args[0];
 	auto dst_name = args[2];
@@ -296,7 +567,7 @@ void CopyStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, c
 	dst->SetValue(src->GetValue());
 }
 
-//void WhileStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+//void WhileStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 //{
 //	auto& state = machine.GetExecutionState();
 //	auto var_name = args[0];
@@ -316,148 +587,112 @@ void CopyStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, c
 //	state.PushScope();
 //}
 
-// simply wait for end statement and handle it
-void WhileStatement::Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+// jump straight past the matching end
+void WhileStatement::Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
-	try {
-		while (true) {
-			machine.Step();
-		}
-	}
-	catch (EndStatementException e) {
-	}
+	machine.GetExecutionState().SetCursor(macros::After(macros::GetEnd(machine, cursor)));
 }
 
-void WhileStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void WhileStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto& state = machine.GetExecutionState();
-	auto var_name = args[0];
-	auto bool_operation = args[1];
-	auto comparison = args[2];
-	auto loop_top = machine.GetExecutionState().GetCursor();
+	auto& condition = machine.DecodeCondition(cursor, "while", args);
+	auto end = macros::GetEnd(machine, cursor);
 
-	auto machine_alias = machine.BuildAlias().Finish();
-	while (!machine_alias.IsFinished())
+	if (!macros::IsConditionTrue(machine, condition))
 	{
-		machine_alias = (!macros::IsConditionTrue(machine_alias, var_name, bool_operation, comparison)) 
-										? machine.BuildAlias()
-												 .NonExecutable()
-												 .Finish() 
-										: machine.BuildAlias()
-												 .Finish();
-		machine_alias.GetExecutionState().PushScope();
-		try {
-			while (!machine_alias.IsFinished())
-				machine_alias.Step();										// wait for end exception
-		}
-		catch (EndStatementException e) {
-			if (macros::IsConditionTrue(machine_alias, var_name, bool_operation, comparison)) {
-				machine_alias.GetExecutionState().SetCursor(loop_top);		// not efficient - always results in the last loop iter being a dud
-				machine_alias.GetExecutionState().PopScope();
-			}
-			else {
-				machine.GetExecutionState().SetCursor(machine_alias.GetExecutionState().GetCursor());
-				break;
-			}
-		}
+		state.SetCursor(macros::After(end));
+		return;
+	}
+
+	// Reaching the end resumes at this statement, which re-tests the condition
+	state.EnterBlock(end, cursor, machine.GetBlockTable().DeclaresVariables(cursor));
+}
+
+void LoopIdiomStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
+{
+	const auto* summary = machine.GetLoopSummary(cursor);
+	const auto& names = summary->GetVariables();
+
+	// The loop condition reads its counter whether or not the body runs
+	auto* counter = macros::GetVariable(machine, names[0]);
+	if (summary->GetIterations(counter->GetValue()) == 0)
+		return WhileStatement::Execute(machine, cursor, args);
+
+	// Otherwise the body touches every variable, so a missing one is an error
+	// part way through. Leave it to the loop itself to fail at the right point.
+	std::vector<Variable*> vars{};
+	for (const auto& name : names)
+	{
+		auto var = macros::GetScope(machine)->GetVariable(name);
+		if (!var.has_value())
+			return WhileStatement::Execute(machine, cursor, args);
+		vars.push_back(var.value());
 	}
+
+	std::vector<int32_t> values{};
+	for (auto* var : vars)
+		values.push_back(var->GetValue());
+	summary->Apply(values);
+	for (size_t i = 0; i < vars.size(); i++)
+		vars[i]->SetValue(values[i]);
+
+	machine.GetExecutionState().SetCursor(macros::After(macros::GetEnd(machine, cursor)));
 }
 
-void EndStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+// Ends of blocks that were entered are handled by BareBones::Step, so
+// executing one means there was no block for it to close.
+void EndStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	throw EndStatementException{};
 }
 
-void InitStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void InitStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto& state = machine.GetExecutionState();
 	auto var_name = args[0];
 	auto* scope = state.GetScope();
 
-	auto var = scope->CreateVariable(var_name);
+	// Proven not to exist yet, so there is nothing to look for
+	if (machine.GetVariableAccess(cursor) == VariableAccess::New)
+		scope->CreateUncheckedVariable(var_name);
+	else
+		scope->CreateVariable(var_name);
 }
 
-bool IfStatement::IsConditionTrue(BareBones& machine, const std::string& cmd, const std::vector<std::string>& args)
+void IfStatement::Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
-	if (cmd == "else")
-		return true;
-
-	return macros::IsConditionTrue(machine, args[0], args[1], args[2]);
+	machine.GetExecutionState().SetCursor(macros::After(macros::GetEnd(machine, cursor)));
 }
 
-bool IfStatement::IsBranchStatement(const std::string& name)
+void IfStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
-	static const std::unordered_set<std::string> branch_statements{ "if", "else", "elif" };
-	return branch_statements.contains(name);
-}
+	auto& state = machine.GetExecutionState();
+	const auto& blocks = machine.GetBlockTable();
+	auto end = macros::GetEnd(machine, cursor);
 
-void IfStatement::Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
-{
-	try {
-		while (true) {
-			machine.Step();
+	// Test each branch in turn by following the chain of elif/else statements
+	auto branch = cursor;
+	auto* condition = &machine.DecodeCondition(cursor, "if", args);
+	while (!macros::IsConditionTrue(machine, *condition))
+	{
+		branch = blocks.GetNextBranch(branch).value();
+		if (branch.GetOrdinal() == end.GetOrdinal())
+		{
+			state.SetCursor(macros::After(end));
+			return;
 		}
-	}
-	catch (EndStatementException e) {
-	}
-}
-
-void IfStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
-{
-	auto machine_alias = machine
-		.BuildAlias()
-		.NonExecutable()
-		.Finish();
 
-	bool is_branch = true;
-	bool found_branch = false;
-	bool cleanup_scope = false;
-	std::string condition_cmd = "if";
-	std::vector<std::string> condition_args = args;
-
-	try {
-		while (true) {
-			if (is_branch && !found_branch && IsConditionTrue(machine_alias, condition_cmd, condition_args)) {
-				// enable execution again
-				found_branch = true;
-				machine_alias = machine
-					.BuildAlias()
-					.Finish();
-				machine_alias.GetExecutionState().PushScope();
-				cleanup_scope = true;
-			}
-			else if (is_branch) {
-				auto rip = machine_alias.GetExecutionState().GetCursor();
-				machine_alias = machine_alias.BuildAlias().NonExecutable().Finish();
-				machine_alias.GetExecutionState().SetCursor(rip);
-			}
-
-			auto exec_result = machine_alias.Step();
-			if (!exec_result.has_value())
-				throw std::runtime_error{ "Its over..." };
-
-			is_branch = IsBranchStatement(exec_result.value().statement_name);
-			if (is_branch)
-			{
-				if (is_branch && cleanup_scope)
-				{
-					machine_alias.GetExecutionState().PopScope();
-					cleanup_scope = false;
-				}	
-				condition_args = exec_result.value().args;
-				condition_cmd = exec_result.value().statement_name;
-			}
-		}
-	}
-	catch (EndStatementException end) {
-		if (cleanup_scope) {
-			machine.GetExecutionState().PopScope();
-		}
-		machine.GetExecutionState().SetCursor(machine_alias.GetExecutionState().GetCursor());
+		const auto* branch_statement = machine.Decode(branch);
+		condition = &machine.DecodeCondition(branch, branch_statement->statement_name, branch_statement->args);
 	}
+
+	// Run the taken branch up to the next elif/else/end, then leave the block
+	state.EnterBlock(blocks.GetNextBranch(branch).value(), macros::After(end), blocks.DeclaresVariables(branch));
+	state.SetCursor(macros::After(branch));
 }
 
-void PrintStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void PrintStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto var_name = args[0];
 	auto* var = macros::GetVariable(machine, var_name);
@@ -469,20 +704,20 @@ const char* EndStatementException::what() const noexcept
 	return "Unexpected end statement encountered during execution.";
 }
 
-void SkippableStatement::Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void SkippableStatement::Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	// noop
 	return;
 }
 
-void NonSkippableStatement::Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void NonSkippableStatement::Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	// defer to Execute(...)
 	Execute(machine, cursor, args);
 }
 
 // add X Y into Z;
-void AddStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void AddStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto lhs_name = args[0];
 	auto rhs_name = args[1];
@@ -493,11 +728,11 @@ void AddStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, co
 	auto* rhs = macros::GetVariable(machine, rhs_name);
 	auto* into = macros::GetVariable(machine, into_name);
 
-	into->SetValue(lhs->GetValue() + rhs->GetValue());
+	into->SetValue(macros::Add(lhs->GetValue(), rhs->GetValue()));
 }
 
 // sub X Y into Z;
-void SubStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void SubStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto lhs_name = args[0];
 	auto rhs_name = args[1];
@@ -508,10 +743,10 @@ void SubStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, co
 	auto* rhs = macros::GetVariable(machine, rhs_name);
 	auto* into = macros::GetVariable(machine, into_name);
 
-	into->SetValue(lhs->GetValue() - rhs->GetValue());
+	into->SetValue(macros::Sub(lhs->GetValue(), rhs->GetValue()));
 }
 
-void MulStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void MulStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto lhs_name = args[0];
 	auto rhs_name = args[1];
@@ -522,10 +757,10 @@ void MulStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, co
 	auto* rhs = macros::GetVariable(machine, rhs_name);
 	auto* into = macros::GetVariable(machine, into_name);
 
-	into->SetValue(lhs->GetValue() * rhs->GetValue());
+	into->SetValue(macros::Mul(lhs->GetValue(), rhs->GetValue()));
 }
 
-void DivStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void DivStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto lhs_name = args[0];
 	auto rhs_name = args[1];
@@ -539,7 +774,7 @@ void DivStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, co
 	into->SetValue(lhs->GetValue() / rhs->GetValue());
 }
 
-void ModStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void ModStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto lhs_name = args[0];
 	auto rhs_name = args[1];
@@ -553,16 +788,23 @@ void ModStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, co
 	into->SetValue(lhs->GetValue() % rhs->GetValue());
 }
 
-void SetStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void SetStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto var_name = args[0];
 	auto val_str = args[1];
-	auto val = std::stoi(val_str);
+	auto val = std::stoi(std::string{ val_str });
 
+	// Whether the variable exists may be known already, saving the lookups
 	Variable* var = nullptr;
-	if (macros::DoesVariableExist(machine, var_name)) {
-		auto* var = macros::GetVariable(machine, var_name);
-		var->SetValue(val);
+	auto access = machine.GetVariableAccess(cursor);
+	if (access == VariableAccess::Existing) {
+		var = macros::GetVariable(machine, var_name);
+	}
+	else if (access == VariableAccess::New) {
+		var = macros::GetScope(machine)->CreateUncheckedVariable(var_name);
+	}
+	else if (macros::DoesVariableExist(machine, var_name)) {
+		var = macros::GetVariable(machine, var_name);
 	}
 	else {
 		var = macros::GetScope(machine)->CreateVariable(var_name);
@@ -571,7 +813,7 @@ void SetStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, co
 	var->SetValue(val);
 }
 
-std::vector<std::string> FunctionDefinitionStatement::DecodeParams(std::vector<std::string>::const_iterator beg, std::vector<std::string>::const_iterator end)
+std::vector<std::string> FunctionDefinitionStatement::DecodeParams(const std::string_view* beg, const std::string_view* end)
 {
 	std::vector<std::string> result{};
 	bool started = false;
@@ -583,7 +825,7 @@ std::vector<std::string> FunctionDefinitionStatement::DecodeParams(std::vector<s
 		else if (str == ")")
 			return result;
 		else if (started)
-			result.push_back(str);
+			result.emplace_back(str);
 	}
 
 	if (!started)
@@ -592,68 +834,110 @@ std::vector<std::string> FunctionDefinitionStatement::DecodeParams(std::vector<s
 		throw std::runtime_error{ "Error in function definition: expected \")\"." };
 }
 
-void FunctionDefinitionStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void FunctionDefinitionStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	auto identifier = args[0];
 	auto params = DecodeParams(args.begin() + 1, args.end());
 	auto address = machine.GetExecutionState().GetCursor();
+	auto end = macros::GetEnd(machine, cursor);
 
-	auto machine_alias = machine.BuildAlias().NonExecutable().Finish();
-	try {
-		while (!machine.IsFinished()) {
-			auto step_result = machine_alias.Step();
+	// Register the call statement and jump over the body
+	machine.GetParser().AddMapping(std::string{ identifier }, new FunctionCallStatement{ params, address, end });
+	machine.GetExecutionState().SetCursor(macros::After(end));
+}
+
+FunctionCallStatement::FunctionCallStatement(const std::vector<std::string>& params, const ExecutionCursor& address, const ExecutionCursor& end)
+	: m_params{ params }, m_address { address }, m_end{ end }
+{
+}
+
+size_t FunctionCallStatement::ArgumentsHash::operator()(const std::vector<int>& values) const
+{
+	size_t hash = values.size();
+	for (auto value : values)
+		hash = hash * 31 + std::hash<int>{}(value);
+	return hash;
+}
+
+// Decided the first time the function is called. Statements that are not
+// recognised yet may become calls to impure functions later, so they count
+// as impure, as do calls back into a function still being checked other than
+// the function itself.
+bool FunctionCallStatement::IsPure(BareBones& machine)
+{
+	if (m_purity == Purity::Unknown)
+	{
+		m_purity = Purity::Checking;
+		bool pure = true;
+		for (auto at = m_address.GetOrdinal(); pure && at < m_end.GetOrdinal(); at++)
+		{
+			auto parsed = machine.GetParser().Parse(machine.GetProgram()->Fetch(at).value());
+			auto* statement = parsed.has_value() ? parsed.value().statement : nullptr;
+			auto* call = dynamic_cast<FunctionCallStatement*>(statement);
+			if (call != nullptr)
+				pure = (call == this) || (call->m_purity != Purity::Checking && call->IsPure(machine));
+			else
+				pure = macros::IsAnyOf<
+					InitStatement, SetStatement, ClearStatement, IncrementStatement, DecrementStatement, CopyStatement,
+					AddStatement, SubStatement, MulStatement, DivStatement, ModStatement,
+					WhileStatement, IfStatement, NoopStatement, EndStatement>(statement);
 		}
+		m_purity = pure ? Purity::Pure : Purity::Impure;
 	}
-	catch (EndStatementException e) {
-		// Finish - create call statement
-		machine.GetParser().AddMapping(identifier, new FunctionCallStatement{ params, address });
-	}
+	return m_purity == Purity::Pure;
 }
 
-FunctionCallStatement::FunctionCallStatement(const std::vector<std::string>& params, const ExecutionCursor& address)
-	: m_params{ params }, m_address { address }
+const FunctionCallStatement::MemoStats& FunctionCallStatement::GetMemoStats() const
 {
+	return m_stats;
 }
 
-void FunctionCallStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args)
+void FunctionCallStatement::Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args)
 {
 	if (args.size() != m_params.size())
 		throw std::runtime_error{ "Incorrect number of arguments passed to function call." };		// TODO: a more helpful message here
 
-	auto machine_alias = machine.BuildAlias()
-								.WithNewBaseScope()
-								.Finish();
+	// Arguments are passed by value, so they are read before anything is left
+	std::vector<int> values{};
+	for (const auto& arg_name : args)
+		values.push_back(macros::GetVariable(machine, arg_name)->GetValue());
 
-	// Create scope
-	auto* scope = macros::PushScope(machine_alias);
-
-	// Load arguments in parameters
-	// TODO: pass by ref
-	for (int i{}; i < args.size(); i++) {
-		auto arg_name = args[i];
-		auto param_name = m_params[i];
-	
-		auto* arg = macros::GetVariable(machine, arg_name);
-		auto* param = scope->CreateVariable(param_name);
-		param->SetValue(arg->GetValue());
+	bool memoize = machine.IsMemoizing() && IsPure(machine);
+	if (memoize && m_memo.contains(values))
+	{
+		m_stats.hits++;
+		return;
 	}
 
-	// Save return address on call stack
-	auto return_address = machine_alias.GetExecutionState().GetCursor();
-
-	// Jump to fn
-	machine_alias.GetExecutionState().SetCursor(m_address);
-	try {
-		while (!machine_alias.IsFinished()) {
-			machine_alias.Step();
-		}
+	// The body is a block that ends at the function's end statement, run by
+	// BareBones::Step like the rest of the program. The caller's cursor
+	// already points past the call.
+	auto& state = machine.GetExecutionState();
+	ControlFrame call{ m_end, state.GetCursor() };
+	if (state.IsTailPosition(state.GetCursor()))
+	{
+		// Returning from here returns from the caller
+		auto caller = state.LeaveCall();
+		call.resume = caller.resume;
+		call.on_leave = std::move(caller.on_leave);
 	}
-	catch (EndStatementException e) {
-		macros::PopScope(machine_alias);
 
-		// Return to prior execution position
-		machine.GetExecutionState().SetCursor(return_address);
+	if (memoize)
+	{
+		m_stats.misses++;
+		call.on_leave.push_back([this, values]() {
+			if (m_memo.size() >= memo_capacity)
+				m_memo.clear();
+			m_memo.insert(values);
+		});
 	}
+
+	// TODO: pass by ref
+	auto* scope = state.EnterCall(std::move(call));
+	for (size_t i{}; i < values.size(); i++)
+		scope->CreateVariable(m_params[i])->SetValue(values[i]);
+
+	state.SetCursor(m_address);
 }
 
 }
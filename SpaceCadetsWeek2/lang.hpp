@@ -2,6 +2,9 @@
 #include "common.hpp"
 #include "parse.hpp"
 #include "runtime.hpp"
+#include "idioms.hpp"
+#include "tokens.hpp"
+#include "keywords.hpp"
 
 namespace bbones {
 
@@ -12,19 +15,22 @@ class BareBones;
 
 class Parser {
 public:
-	std::unordered_map<std::string, IStatement*> m_mappings{};
-	std::optional<IStatement*> GetStatementFor(const std::string& keyword);
-	std::vector<std::string> ParseArgs(int after_pos, const std::string& statement);
+	std::array<IStatement*, keyword_count> m_keywords{};	// built in statements, indexed by Keyword
+	StringMap<IStatement*> m_mappings{};					// every other name, such as user defined functions
+	std::optional<IStatement*> GetStatementFor(std::string_view keyword) const;
+	std::optional<IStatement*> GetStatementFor(Keyword keyword) const;
+	Tokens ParseArgs(size_t after_pos, std::string_view statement) const;
 
 public:
 	Parser() = default;
 
+	// Views into the parsed text, which has to outlive the result
 	struct ParserResult {
-		std::string statement_name{};
+		std::string_view statement_name{};
 		IStatement* statement{};
-		std::vector<std::string> args{};
+		Tokens args{};
 	};
-	std::optional<ParserResult> Parse(const std::string& statement);
+	std::optional<ParserResult> Parse(std::string_view statement) const;
 	void AddMapping(const std::string& keyword, IStatement* statement);
 
 	static ParserBuilder Builder();
@@ -41,25 +47,92 @@ public:
 	Parser Finish();
 };
 
+enum class Comparison : uint8_t {
+	Is,
+	Not,
+	Lt,
+	Lte,
+	Gt,
+	Gte,
+	Always,
+};
+
+std::optional<Comparison> DecodeComparison(std::string_view operation);
+
+// The test of a while, if or elif, decoded when it is first reached. The
+// right hand side is a literal, or a variable if it is not an integer.
+struct Condition {
+	Comparison cmp{Comparison::Always};		// Always for an else
+	std::string lhs{};
+	std::string rhs{};						// empty when comparing with the literal
+	int32_t literal{};
+
+	// The operands as found from the scope of the last test, by frame serial.
+	// A name bound in a frame cannot be bound again while it is open, so they
+	// are only looked up again once the test runs in another frame.
+	uint64_t resolved_in{};
+	Variable* lhs_var{};
+	Variable* rhs_var{};
+};
+
+// Everything about a running program that is the same for every view onto
+// it: the statement set (including functions registered as they are defined),
+// the program text, its block structure and the statements decoded so far.
+// Shared with aliases, which see functions defined through each other. A copy
+// gets its own context, but the functions defined before the copy was made
+// are the same statements, so their memoized calls are shared. A memoized
+// call does nothing, so sharing is not observable.
+class ProgramContext {
+private:
+	Parser m_parser{};
+	IProgram* m_program{};
+	BlockTable m_blocks{};
+	std::vector<std::optional<Parser::ParserResult>> m_decoded{};
+	std::unordered_map<size_t, LoopSummary> m_loops{};
+	std::vector<VariableAccess> m_accesses{};
+	std::unordered_map<size_t, Condition> m_conditions{};
+	bool m_memoize{true};
+
+	bool HasBuiltinLoopStatements();
+	void SummariseLoops();
+	std::optional<Parser::ParserResult> DecodeStatement(const ExecutionCursor& ip) const;
+	void DecodeAll();
+
+public:
+	// accesses are what an Analyzer proved about the program. Without them
+	// every statement checks its variables as it runs.
+	ProgramContext(const Parser& parser, IProgram* program, std::vector<VariableAccess> accesses = {});
+
+	Parser& GetParser();
+	IProgram* GetProgram();
+	const BlockTable& GetBlockTable() const;
+	const Parser::ParserResult* Decode(const ExecutionCursor& ip);
+	const LoopSummary* GetLoopSummary(const ExecutionCursor& opener) const;
+	Condition& DecodeCondition(const ExecutionCursor& ip, std::string_view keyword, const Tokens& args);
+	VariableAccess GetVariableAccess(const ExecutionCursor& ip) const;
+	bool IsMemoizing() const;
+	void SetMemoizing(bool enabled);
+};
+
 class BareBonesBuilder {
 private:
 	struct Prototype {
-		Parser parser;
+		std::shared_ptr<ProgramContext> context;
 		std::shared_ptr<ExecutionState> cpu;
-		IProgram* program;
 	};
 
 	Prototype m_proto;
 	bool m_nx{};
 
 public:
-	BareBonesBuilder(Parser parser, std::shared_ptr<ExecutionState> state, IProgram* program);
+	BareBonesBuilder(std::shared_ptr<ProgramContext> context, std::shared_ptr<ExecutionState> state);
 
 	BareBonesBuilder& NonExecutable();
 	BareBonesBuilder& WithNewBaseScope();
 	BareBones Finish();
 };
 
+// What a single step did, as reported by BareBones::TraceStep
 struct BareBonesStep {
 	std::string statement_name{};
 	std::vector<std::string> args{};
@@ -79,9 +152,8 @@ struct BareBonesStep {
 
 class BareBones {
 private:
-	Parser m_parser{};
+	std::shared_ptr<ProgramContext> m_context{};
 	std::shared_ptr<ExecutionState> m_cpu{};
-	IProgram* m_program{};
 	bool m_finished{};
 	bool m_nx{};
 
@@ -90,13 +162,26 @@ private:
 	bool DoExecution();
 
 public:
-	BareBones(const Parser& parser, std::shared_ptr<ExecutionState> state, IProgram* program, bool nx);
+	BareBones(std::shared_ptr<ProgramContext> context, std::shared_ptr<ExecutionState> state, bool nx);
 
-	static BareBones Create(const Parser& parser, IProgram* program);
+	static BareBones Create(const Parser& parser, IProgram* program, std::vector<VariableAccess> accesses = {});
 	ExecutionState& GetExecutionState();
 	Parser& GetParser();
+	const BlockTable& GetBlockTable() const;
+	IProgram* GetProgram();
+	const Parser::ParserResult* Decode(const ExecutionCursor& ip);
+	const LoopSummary* GetLoopSummary(const ExecutionCursor& opener) const;
+	Condition& DecodeCondition(const ExecutionCursor& ip, std::string_view keyword, const Tokens& args);
+	VariableAccess GetVariableAccess(const ExecutionCursor& ip) const;
+	// Calls to pure functions are skipped when the same arguments have been
+	// passed before (see FunctionCallStatement). On unless turned off.
+	bool IsMemoizing() const;
+	void SetMemoizing(bool enabled);
 	void Execute();
-	std::optional<BareBonesStep> Step();
+	// Run one statement, or leave one block. False once the program has finished.
+	bool Step();
+	// As Step, but reports what ran. Copies the statement, so is for debugging only.
+	std::optional<BareBonesStep> TraceStep();
 	bool IsFinished();
 
 	BareBonesBuilder BuildAlias();
@@ -107,22 +192,22 @@ class IStatement
 {
 public:
 	virtual ~IStatement() = default;
-	virtual void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) = 0;
-	virtual void Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) = 0;
+	virtual void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) = 0;
+	virtual void Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) = 0;
 };
 
 class SkippableStatement : public IStatement
 {
 public:
 	virtual ~SkippableStatement() = default;
-	void Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class NonSkippableStatement : public IStatement
 {
 public:
 	virtual ~NonSkippableStatement() = default;
-	void Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class ClearStatement : public SkippableStatement {
@@ -130,7 +215,7 @@ public:
 	ClearStatement() = default;
 	virtual ~ClearStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class IncrementStatement : public SkippableStatement {
@@ -138,7 +223,7 @@ public:
 	IncrementStatement() = default;
 	virtual ~IncrementStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class DecrementStatement : public SkippableStatement {
@@ -146,7 +231,7 @@ public:
 	DecrementStatement() = default;
 	virtual ~DecrementStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class CopyStatement : public SkippableStatement {
@@ -154,7 +239,7 @@ public:
 	CopyStatement() = default;
 	virtual ~CopyStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 //class WhileStatement : public SkippableStatement {
@@ -163,8 +248,18 @@ public:
 	WhileStatement() = default;
 	virtual ~WhileStatement() = default;
 
-	void Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
+};
+
+// A while loop that SummariseLoop recognised as an idiom. Runs in a single
+// step, or as a plain while loop if any of its variables do not exist.
+class LoopIdiomStatement : public WhileStatement {
+public:
+	LoopIdiomStatement() = default;
+	virtual ~LoopIdiomStatement() = default;
+
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class EndStatementException : public std::exception {
@@ -178,103 +273,131 @@ class EndStatement : public NonSkippableStatement {
 public:
 	virtual ~EndStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class InitStatement : public SkippableStatement {
 public:
 	virtual ~InitStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class SetStatement : public SkippableStatement {
 public:
 	virtual ~SetStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class IfStatement : public IStatement {
-private:
-	bool IsBranchStatement(const std::string& name);
-	bool IsConditionTrue(BareBones& machine, const std::string& cmd, const std::vector<std::string>& args);
-
 public:
 	virtual ~IfStatement() = default;
 
-	void Skip(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Skip(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class NoopStatement : public SkippableStatement {
 public:
 	virtual ~NoopStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class PrintStatement : public SkippableStatement {
 public:
 	virtual ~PrintStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class AddStatement : public SkippableStatement {
 public:
 	virtual ~AddStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class SubStatement : public SkippableStatement {
 public:
 	virtual ~SubStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class MulStatement : public SkippableStatement {
 public:
 	virtual ~MulStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class DivStatement : public SkippableStatement {
 public:
 	virtual ~DivStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class ModStatement : public SkippableStatement {
 public:
 	virtual ~ModStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
 class FunctionDefinitionStatement : public SkippableStatement {
 private:
-	std::vector<std::string> DecodeParams(std::vector<std::string>::const_iterator beg, std::vector<std::string>::const_iterator end);
+	std::vector<std::string> DecodeParams(const std::string_view* beg, const std::string_view* end);
 
 public:
 	virtual ~FunctionDefinitionStatement() = default;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 
+// Functions are pure if their bodies print nothing, define no functions and
+// only call pure functions. Since they also cannot see their caller's
+// variables and return nothing, a call to one that has finished once does
+// nothing when repeated with the same arguments, and is skipped.
 class FunctionCallStatement : public SkippableStatement {
+public:
+	struct MemoStats {
+		size_t hits{};					// calls skipped
+		size_t misses{};				// calls to a pure function that ran the body
+	};
+
 private:
+	enum class Purity {
+		Unknown,
+		Checking,
+		Pure,
+		Impure,
+	};
+
+	struct ArgumentsHash {
+		size_t operator()(const std::vector<int>& values) const;
+	};
+
+	// Forgotten all at once when full
+	static constexpr size_t memo_capacity = 1 << 16;
+
 	std::vector<std::string> m_params{};
 	ExecutionCursor m_address{};
+	ExecutionCursor m_end{};
+	Purity m_purity{};
+	std::unordered_set<std::vector<int>, ArgumentsHash> m_memo{};
+	MemoStats m_stats{};
+
+	bool IsPure(BareBones& machine);
 
 public:
 	virtual ~FunctionCallStatement() = default;
-	FunctionCallStatement(const std::vector<std::string>& params, const ExecutionCursor& address);
+	FunctionCallStatement(const std::vector<std::string>& params, const ExecutionCursor& address, const ExecutionCursor& end);
+
+	const MemoStats& GetMemoStats() const;
 
-	void Execute(BareBones& machine, const ExecutionCursor& cursor, const std::vector<std::string>& args) override;
+	void Execute(BareBones& machine, const ExecutionCursor& cursor, const Tokens& args) override;
 };
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "mapped_file.hpp"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bbones {
+
+MappedFile::MappedFile(const char* data, size_t size)
+	: m_data{data}, m_size{size}
+{
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: m_data{std::exchange(other.m_data, nullptr)}, m_size{std::exchange(other.m_size, 0)}
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data == nullptr)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+#else
+	munmap(const_cast<char*>(m_data), m_size);
+#endif
+}
+
+#ifdef _WIN32
+std::optional<MappedFile> MappedFile::Open(const std::string& path)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return std::nullopt;
+
+	LARGE_INTEGER size{};
+	if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return std::nullopt;
+	}
+	if (size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return MappedFile{};
+	}
+
+	// The view keeps the file mapped once both handles are closed
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr)
+		return std::nullopt;
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data == nullptr)
+		return std::nullopt;
+
+	return MappedFile{ static_cast<const char*>(data), static_cast<size_t>(size.QuadPart) };
+}
+#else
+std::optional<MappedFile> MappedFile::Open(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return std::nullopt;
+
+	struct stat info{};
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(fd);
+		return std::nullopt;
+	}
+	if (info.st_size == 0)
+	{
+		close(fd);
+		return MappedFile{};
+	}
+
+	// The mapping outlives the descriptor
+	auto size = static_cast<size_t>(info.st_size);
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return std::nullopt;
+
+	madvise(data, size, MADV_SEQUENTIAL);
+	return MappedFile{ static_cast<const char*>(data), size };
+}
+#endif
+
+std::string_view MappedFile::GetView() const
+{
+	return { m_data, m_size };
+}
+
+}
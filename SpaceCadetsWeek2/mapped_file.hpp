@@ -0,0 +1,31 @@
+#pragma once
+#include "common.hpp"
+#include <string_view>
+
+namespace bbones {
+
+// A whole file mapped read only into memory, unmapped when destroyed.
+// Empty files have nothing to map and give an empty view.
+class MappedFile {
+private:
+	const char* m_data{};
+	size_t m_size{};
+
+	MappedFile(const char* data, size_t size);
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	// None if the file cannot be opened or is not something that can be
+	// mapped, such as a pipe
+	static std::optional<MappedFile> Open(const std::string& path);
+
+	std::string_view GetView() const;
+};
+
+}
@@ -0,0 +1,741 @@
+#include "optimizer.hpp"
+#include "dataflow.hpp"
+#include <algorithm>
+#include <functional>
+
+namespace bbones {
+
+namespace {
+	// Bounds the rare programs where each round enables a little more. Only
+	// unrolling grows the code, and only by a bounded amount per loop.
+	constexpr size_t max_rounds = 8;
+
+	bool IsFused(const Bytecode& code)
+	{
+		return std::any_of(code.code.begin(), code.code.end(), [](const auto& insn) { return insn.op >= OpCode::EndWhile; });
+	}
+
+	bool IsArithmetic(OpCode op)
+	{
+		return op >= OpCode::Add && op <= OpCode::Mod;
+	}
+
+	// Instructions that only write a slot, which can go if nothing reads it
+	bool IsStore(OpCode op)
+	{
+		switch (op)
+		{
+		case OpCode::Init:
+		case OpCode::Clear:
+		case OpCode::Incr:
+		case OpCode::Decr:
+		case OpCode::Copy:
+		case OpCode::Set:
+		case OpCode::Add:
+		case OpCode::Sub:
+		case OpCode::Mul:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	PassReport PropagateConstants(Bytecode& code)
+	{
+		PassReport report{};
+		auto states = FindConstants(code);
+		for (size_t at{}; at < code.code.size(); at++)
+		{
+			auto& insn = code.code[at];
+			if (!states[at].has_value())
+				continue;
+
+			if (insn.op == OpCode::Copy && states[at].value()[insn.a].has_value())
+			{
+				insn = { OpCode::Set, {}, {}, states[at].value()[insn.a].value(), insn.c };
+				report.rewritten++;
+			}
+			else if ((insn.op == OpCode::While || insn.op == OpCode::If) && insn.slot_b && states[at].value()[insn.b].has_value())
+			{
+				insn.b = states[at].value()[insn.b].value();
+				insn.slot_b = false;
+				report.rewritten++;
+			}
+		}
+		return report;
+	}
+
+	PassReport PropagateCopies(Bytecode& code)
+	{
+		PassReport report{};
+		auto states = FindCopies(code);
+		std::vector<bool> removed(code.code.size());
+		for (size_t at{}; at < code.code.size(); at++)
+		{
+			if (!states[at].has_value())
+				continue;
+
+			const auto& copies = states[at].value();
+			auto& insn = code.code[at];
+			bool rewritten = false;
+			auto forward = [&](int32_t& slot) {
+				if (copies[slot] >= 0)
+				{
+					slot = copies[slot];
+					rewritten = true;
+				}
+			};
+
+			switch (insn.op)
+			{
+			case OpCode::Copy:
+			case OpCode::Print:
+				forward(insn.a);
+				break;
+			case OpCode::Add:
+			case OpCode::Sub:
+			case OpCode::Mul:
+			case OpCode::Div:
+			case OpCode::Mod:
+				forward(insn.a);
+				forward(insn.b);
+				break;
+			case OpCode::While:
+			case OpCode::If:
+				if (insn.cmp != Comparison::Always)
+					forward(insn.a);
+				if (insn.cmp != Comparison::Always && insn.slot_b)
+					forward(insn.b);
+				break;
+			case OpCode::Call:
+				for (auto& slot : GetOperands(code, insn))
+					forward(slot);
+				break;
+			default:
+				break;
+			}
+
+			if (insn.op == OpCode::Copy && insn.a == insn.c)
+				removed[at] = true;
+			else if (rewritten)
+				report.rewritten++;
+		}
+
+		report.removed = std::count(removed.begin(), removed.end(), true);
+		Compact(code, removed);
+		return report;
+	}
+
+	PassReport FoldConstants(Bytecode& code)
+	{
+		PassReport report{};
+		auto states = FindConstants(code);
+		std::vector<bool> removed(code.code.size());
+		for (size_t at{}; at < code.code.size(); at++)
+		{
+			auto& insn = code.code[at];
+			if (!states[at].has_value())
+			{
+				// Kept so that functions and the program still have their bounds
+				removed[at] = insn.op != OpCode::Function && insn.op != OpCode::Return && insn.op != OpCode::Halt;
+				continue;
+			}
+
+			const auto& values = states[at].value();
+			if ((insn.op == OpCode::Incr || insn.op == OpCode::Decr) && values[insn.a].has_value())
+			{
+				auto result = Fold(OpCode::Add, values[insn.a].value(), (insn.op == OpCode::Incr) ? 1 : -1);
+				insn = { OpCode::Set, {}, {}, result.value(), insn.a };
+				report.rewritten++;
+			}
+			else if (IsArithmetic(insn.op) && values[insn.a].has_value() && values[insn.b].has_value())
+			{
+				auto result = Fold(insn.op, values[insn.a].value(), values[insn.b].value());
+				if (result.has_value())
+				{
+					insn = { OpCode::Set, {}, {}, result.value(), insn.c };
+					report.rewritten++;
+				}
+			}
+			else if ((insn.op == OpCode::While || insn.op == OpCode::If) && insn.cmp != Comparison::Always
+				&& values[insn.a].has_value() && GetComparand(insn, values).has_value())
+			{
+				// A test that always passes falls through, one that always fails is a jump
+				if (!IsConditionTrue(insn.cmp, values[insn.a].value(), GetComparand(insn, values).value()))
+					insn = { OpCode::Else, {}, {}, {}, {}, insn.target };
+				else if (insn.op == OpCode::If)
+					removed[at] = true;
+				else
+					insn = { OpCode::While, Comparison::Always, {}, {}, {}, insn.target };
+				report.rewritten += removed[at] ? 0 : 1;
+			}
+		}
+
+		// Jumps to the next instruction left are no-ops
+		for (int32_t at{}; at < static_cast<int32_t>(code.code.size()); at++)
+		{
+			const auto& insn = code.code[at];
+			if (removed[at] || (insn.op != OpCode::Else && insn.op != OpCode::End) || insn.target <= at)
+				continue;
+			auto skipped = removed.begin() + insn.target;
+			removed[at] = std::find(removed.begin() + at + 1, skipped, false) == skipped;
+		}
+
+		report.removed = std::count(removed.begin(), removed.end(), true);
+		Compact(code, removed);
+		return report;
+	}
+
+	PassReport EliminateDeadStores(Bytecode& code)
+	{
+		PassReport report{};
+		auto live = FindLiveSlots(code);
+		std::vector<bool> removed(code.code.size());
+		for (size_t at{}; at < code.code.size(); at++)
+		{
+			const auto& insn = code.code[at];
+			if (!IsStore(insn.op))
+				continue;
+
+			auto writes = GetWrites(code, insn);
+			removed[at] = std::none_of(writes.begin(), writes.end(), [&](auto slot) { return live.out[at][slot]; });
+		}
+
+		report.removed = std::count(removed.begin(), removed.end(), true);
+		Compact(code, removed);
+		return report;
+	}
+
+	// A while statement: the test at `opener`, the body, then the End at
+	// exit - 1 jumping back to the test
+	struct Loop {
+		int32_t opener{};
+		int32_t exit{};
+		int32_t frame{};
+	};
+
+	std::vector<Loop> FindLoops(const Bytecode& code, const std::vector<int32_t>& frames)
+	{
+		std::vector<Loop> loops{};
+		for (int32_t at{}; at < static_cast<int32_t>(code.code.size()); at++)
+		{
+			const auto& insn = code.code[at];
+			if (insn.op != OpCode::While || insn.target <= at + 1)
+				continue;
+			const auto& back = code.code[insn.target - 1];
+			if (back.op == OpCode::End && back.target == at)
+				loops.push_back({ at, insn.target, frames[at] });
+		}
+		return loops;
+	}
+
+	// Instructions of the body run by this frame, not by functions defined in it
+	bool IsInBody(const Loop& loop, const std::vector<int32_t>& frames, int32_t at)
+	{
+		return at > loop.opener && at < loop.exit - 1 && frames[at] == loop.frame;
+	}
+
+	// How many instructions of the body write each slot
+	std::vector<int32_t> CountWrites(Bytecode& code, const Loop& loop, const std::vector<int32_t>& frames)
+	{
+		std::vector<int32_t> writes(GetSlotCount(code));
+		for (int32_t at = loop.opener + 1; at < loop.exit - 1; at++)
+		{
+			if (!IsInBody(loop, frames, at))
+				continue;
+			for (auto slot : GetWrites(code, code.code[at]))
+				writes[slot]++;
+		}
+		return writes;
+	}
+
+	// Whether one iteration can get from the top of the body to `to` without running `avoid`
+	bool Reaches(const Bytecode& code, const Loop& loop, int32_t to, int32_t avoid)
+	{
+		std::vector<bool> seen(code.code.size());
+		std::vector<int32_t> pending{ loop.opener + 1 };
+		while (!pending.empty())
+		{
+			auto at = pending.back();
+			pending.pop_back();
+			if (at == avoid || at <= loop.opener || at >= loop.exit || seen[at])
+				continue;
+			if (at == to)
+				return true;
+			seen[at] = true;
+			for (auto next : GetSuccessors(code.code[at], at))
+				pending.push_back(next);
+		}
+		return false;
+	}
+
+	// Runs exactly once on every iteration that gets back to the test
+	bool RunsEveryIteration(const Bytecode& code, const Loop& loop, int32_t at)
+	{
+		for (int32_t inner = loop.opener + 1; inner < at; inner++)
+		{
+			if (code.code[inner].op == OpCode::While && code.code[inner].target > at)
+				return false;
+		}
+		return Reaches(code, loop, loop.exit - 1, -1) && !Reaches(code, loop, loop.exit - 1, at);
+	}
+
+	// Add `preheader` in front of the test, run once each time the loop is entered
+	void InsertBefore(Bytecode& code, const Loop& loop, const std::vector<Instruction>& preheader)
+	{
+		auto count = static_cast<int32_t>(preheader.size());
+		for (int32_t at{}; at < static_cast<int32_t>(code.code.size()); at++)
+		{
+			auto& insn = code.code[at];
+			bool inside = at >= loop.opener && at < loop.exit;
+			if (HasTarget(insn.op) && (insn.target > loop.opener || (insn.target == loop.opener && inside)))
+				insn.target += count;
+		}
+
+		for (auto& function : code.functions)
+		{
+			if (function.entry > loop.opener)
+				function.entry += count;
+		}
+		code.code.insert(code.code.begin() + loop.opener, preheader.begin(), preheader.end());
+	}
+
+	// Replace [first, last) with `with`. Jumps into the range are already
+	// relocated, jumps past it move along with the code after it.
+	void Splice(Bytecode& code, int32_t first, int32_t last, const std::vector<Instruction>& with)
+	{
+		auto growth = static_cast<int32_t>(with.size()) - (last - first);
+		for (auto& insn : code.code)
+		{
+			if (HasTarget(insn.op) && insn.target >= last)
+				insn.target += growth;
+		}
+
+		for (auto& function : code.functions)
+		{
+			if (function.entry >= last)
+				function.entry += growth;
+		}
+		code.code.erase(code.code.begin() + first, code.code.begin() + last);
+		code.code.insert(code.code.begin() + first, with.begin(), with.end());
+	}
+
+	// `count` fresh slots at the end of a frame, None if the frame is not known
+	std::optional<int32_t> AddSlots(Bytecode& code, int32_t frame, int32_t count)
+	{
+		auto* size = &code.frame_size;
+		if (frame >= 0)
+		{
+			auto function = std::find_if(code.functions.begin(), code.functions.end(), [&](const auto& info) { return info.entry == frame + 1; });
+			if (function == code.functions.end())
+				return std::nullopt;
+			size = &function->frame_size;
+		}
+
+		auto first = *size;
+		*size += count;
+		return first;
+	}
+
+	bool HoistInvariant(Bytecode& code)
+	{
+		auto frames = GetFrames(code);
+		auto live = FindLiveSlots(code);
+		for (const auto& loop : FindLoops(code, frames))
+		{
+			auto writes = CountWrites(code, loop, frames);
+			for (int32_t at = loop.opener + 1; at < loop.exit - 1; at++)
+			{
+				const auto& insn = code.code[at];
+				if (!IsInBody(loop, frames, at) || !IsStore(insn.op) || insn.op == OpCode::Incr || insn.op == OpCode::Decr)
+					continue;
+
+				// Same operands on every iteration, and the result is only ever
+				// read after this has run in the same iteration
+				auto reads = GetReads(code, insn);
+				auto slot = GetWrites(code, insn).front();
+				if (std::any_of(reads.begin(), reads.end(), [&](auto read) { return writes[read] > 0; })
+					|| writes[slot] != 1 || live.in[loop.opener][slot] || live.in[loop.exit][slot])
+					continue;
+
+				auto hoisted = insn;
+				InsertBefore(code, loop, { hoisted });
+				std::vector<bool> removed(code.code.size());
+				removed[at + 1] = true;
+				Compact(code, removed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	PassReport HoistInvariants(Bytecode& code)
+	{
+		// Each hoist moves an instruction out of one more loop, so this ends
+		PassReport report{};
+		while (HoistInvariant(code))
+			report.rewritten++;
+		return report;
+	}
+
+	// A slot that the body steps by the same amount once every iteration
+	struct Induction {
+		int32_t update{};			// the instruction doing so
+		OpCode op{};				// Add or Sub
+		std::optional<int32_t> step{};	// slot holding the step, None for one
+	};
+
+	std::optional<Induction> FindInduction(Bytecode& code, const Loop& loop, const std::vector<int32_t>& frames, const std::vector<int32_t>& writes, int32_t slot)
+	{
+		if (writes[slot] != 1)
+			return std::nullopt;
+
+		for (int32_t at = loop.opener + 1; at < loop.exit - 1; at++)
+		{
+			const auto& insn = code.code[at];
+			if (!IsInBody(loop, frames, at))
+				continue;
+			auto written = GetWrites(code, insn);
+			if (std::find(written.begin(), written.end(), slot) == written.end())
+				continue;
+			if (!RunsEveryIteration(code, loop, at))
+				return std::nullopt;
+
+			if (insn.op == OpCode::Incr || insn.op == OpCode::Decr)
+				return Induction{ at, (insn.op == OpCode::Incr) ? OpCode::Add : OpCode::Sub };
+			if ((insn.op == OpCode::Add || insn.op == OpCode::Sub) && insn.a == slot && insn.c == slot && writes[insn.b] == 0)
+				return Induction{ at, insn.op, insn.b };
+			return std::nullopt;
+		}
+		return std::nullopt;
+	}
+
+	// mul i k into t, with i an induction variable and k the same on every
+	// iteration, becomes a running add of i's step times k to t
+	bool ReduceMultiply(Bytecode& code)
+	{
+		auto frames = GetFrames(code);
+		auto live = FindLiveSlots(code);
+		for (const auto& loop : FindLoops(code, frames))
+		{
+			auto writes = CountWrites(code, loop, frames);
+			for (int32_t at = loop.opener + 1; at < loop.exit - 1; at++)
+			{
+				auto insn = code.code[at];
+				if (!IsInBody(loop, frames, at) || insn.op != OpCode::Mul)
+					continue;
+				if (writes[insn.a] == 0 && writes[insn.b] != 0)
+					std::swap(insn.a, insn.b);
+
+				auto product = insn.c;
+				if (writes[insn.b] != 0 || writes[product] != 1 || product == insn.a || product == insn.b
+					|| live.in[loop.opener][product] || live.in[loop.exit][product] || !RunsEveryIteration(code, loop, at))
+					continue;
+
+				auto induction = FindInduction(code, loop, frames, writes, insn.a);
+				if (!induction.has_value())
+					continue;
+
+				// Whichever of the two runs first in the body runs first on every path
+				bool before = !Reaches(code, loop, induction->update, at);
+				if (!before && Reaches(code, loop, at, induction->update))
+					continue;
+
+				std::vector<Instruction> preheader{};
+				auto step = insn.b;
+				if (induction->step.has_value())
+				{
+					auto slot = AddSlots(code, loop.frame, 1);
+					if (!slot.has_value())
+						continue;
+					step = slot.value();
+					preheader.push_back({ OpCode::Mul, {}, induction->step.value(), insn.b, step });
+				}
+				preheader.push_back({ OpCode::Mul, {}, insn.a, insn.b, product });
+				// The first iteration adds the step before reading the product
+				if (before)
+					preheader.push_back({ (induction->op == OpCode::Add) ? OpCode::Sub : OpCode::Add, {}, product, step, product });
+
+				code.code[at] = { induction->op, {}, product, step, product };
+				InsertBefore(code, loop, preheader);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	PassReport ReduceStrength(Bytecode& code)
+	{
+		// Products are not multiplications afterwards, so this ends
+		PassReport report{};
+		while (ReduceMultiply(code))
+			report.rewritten++;
+		return report;
+	}
+
+	constexpr int32_t max_unrolled_trips = 8;
+	constexpr int32_t max_unrolled_size = 64;
+
+	// Values of slots on the way into the loop, None if it is never entered
+	std::optional<Constants> FindEntryConstants(Bytecode& code, const Loop& loop, const std::vector<std::optional<Constants>>& states)
+	{
+		std::optional<Constants> entry{};
+		for (int32_t at{}; at < static_cast<int32_t>(code.code.size()); at++)
+		{
+			if ((at >= loop.opener && at < loop.exit) || !states[at].has_value())
+				continue;
+
+			auto values = states[at].value();
+			auto next = TransferConstants(code, at, values);
+			if (std::find(next.begin(), next.end(), loop.opener) == next.end())
+				continue;
+
+			if (!entry.has_value())
+			{
+				entry = std::move(values);
+				continue;
+			}
+			for (size_t slot{}; slot < values.size(); slot++)
+			{
+				if (entry.value()[slot] != values[slot])
+					entry.value()[slot] = std::nullopt;
+			}
+		}
+		return entry;
+	}
+
+	// How many times the test passes, None if that is not known or too many
+	std::optional<int32_t> FindTripCount(Bytecode& code, const Loop& loop, const std::vector<int32_t>& frames, const std::optional<Constants>& entry)
+	{
+		const auto& test = code.code[loop.opener];
+		if (!entry.has_value() || test.cmp == Comparison::Always || test.slot_b)
+			return std::nullopt;
+
+		auto writes = CountWrites(code, loop, frames);
+		auto induction = FindInduction(code, loop, frames, writes, test.a);
+		auto value = entry.value()[test.a];
+		if (!induction.has_value() || !value.has_value())
+			return std::nullopt;
+
+		auto step = induction->step.has_value() ? entry.value()[induction->step.value()] : 1;
+		if (!step.has_value())
+			return std::nullopt;
+
+		int32_t trips{};
+		while (IsConditionTrue(test.cmp, value.value(), test.b))
+		{
+			if (++trips > max_unrolled_trips)
+				return std::nullopt;
+			value = Fold(induction->op, value.value(), step.value());
+		}
+		return trips;
+	}
+
+	bool UnrollLoop(Bytecode& code)
+	{
+		auto frames = GetFrames(code);
+		auto states = FindConstants(code);
+		for (const auto& loop : FindLoops(code, frames))
+		{
+			auto first = loop.opener + 1;
+			auto size = loop.exit - 1 - first;
+			auto body = code.code.begin() + first;
+			if (!states[loop.opener].has_value() || std::any_of(body, body + size, [](const auto& insn) { return insn.op == OpCode::Function; }))
+				continue;
+
+			auto trips = FindTripCount(code, loop, frames, FindEntryConstants(code, loop, states));
+			if (!trips.has_value() || trips.value() == 0 || trips.value() * size > max_unrolled_size)
+				continue;
+
+			// Each copy continues into the next one where the body would go back to the test
+			std::vector<Instruction> unrolled{};
+			for (int32_t copy{}; copy < trips.value(); copy++)
+			{
+				auto start = loop.opener + copy * size;
+				for (auto insn : std::vector<Instruction>{ body, body + size })
+				{
+					if (HasTarget(insn.op) && insn.target >= first && insn.target < loop.exit)
+						insn.target = start + insn.target - first;
+					unrolled.push_back(insn);
+				}
+			}
+
+			Splice(code, loop.opener, loop.exit, unrolled);
+			return true;
+		}
+		return false;
+	}
+
+	PassReport UnrollLoops(Bytecode& code)
+	{
+		// Every unrolled loop is gone afterwards, so this ends
+		PassReport report{};
+		while (UnrollLoop(code))
+			report.rewritten++;
+		return report;
+	}
+
+	// Body of a function, from its entry up to the Return, if it is small
+	// enough and calls nothing, so inlining it can never recurse
+	std::optional<std::pair<int32_t, int32_t>> FindInlineBody(const Bytecode& code, const FunctionInfo& function, size_t budget)
+	{
+		const auto& opener = code.code[function.entry - 1];
+		auto last = opener.target - 1;
+		if (opener.op != OpCode::Function || code.code[last].op != OpCode::Return || static_cast<size_t>(last - function.entry) > budget)
+			return std::nullopt;
+
+		auto body = code.code.begin();
+		if (std::any_of(body + function.entry, body + last, [](const auto& insn) { return insn.op == OpCode::Function || insn.op == OpCode::Call; }))
+			return std::nullopt;
+		return std::pair{ function.entry, last };
+	}
+
+	// The callee's slots become slots from `base` up in the caller's frame
+	void RenameSlots(Bytecode& code, Instruction& insn, int32_t base)
+	{
+		switch (insn.op)
+		{
+		case OpCode::Init:
+		case OpCode::Clear:
+		case OpCode::Incr:
+		case OpCode::Decr:
+		case OpCode::Print:
+			insn.a += base;
+			break;
+		case OpCode::Copy:
+			insn.a += base;
+			insn.c += base;
+			break;
+		case OpCode::Set:
+			insn.c += base;
+			break;
+		case OpCode::Add:
+		case OpCode::Sub:
+		case OpCode::Mul:
+		case OpCode::Div:
+		case OpCode::Mod:
+			insn.a += base;
+			insn.b += base;
+			insn.c += base;
+			break;
+		case OpCode::While:
+		case OpCode::If:
+			if (insn.cmp != Comparison::Always)
+				insn.a += base;
+			if (insn.cmp != Comparison::Always && insn.slot_b)
+				insn.b += base;
+			break;
+		case OpCode::Loop: {
+			auto offset = static_cast<int32_t>(code.operands.size());
+			for (int32_t i{}; i < insn.c; i++)
+				code.operands.push_back(code.operands[insn.b + i] + base);
+			insn.b = offset;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	bool InlineCall(Bytecode& code, size_t budget)
+	{
+		auto frames = GetFrames(code);
+		for (int32_t at{}; at < static_cast<int32_t>(code.code.size()); at++)
+		{
+			auto call = code.code[at];
+			if (call.op != OpCode::Call)
+				continue;
+
+			auto function = code.functions[call.a];
+			auto body = FindInlineBody(code, function, budget);
+			if (!body.has_value())
+				continue;
+			auto base = AddSlots(code, frames[at], function.frame_size);
+			if (!base.has_value())
+				continue;
+
+			// Arguments are copied in as Call does, then the body runs in place
+			// and leaves where the Return would have gone back to
+			auto [first, last] = body.value();
+			std::vector<Instruction> inlined{};
+			for (int32_t i{}; i < call.c; i++)
+				inlined.push_back({ OpCode::Copy, {}, code.operands[call.b + i], {}, base.value() + function.params[i] });
+
+			auto start = at + static_cast<int32_t>(inlined.size());
+			for (auto from = first; from < last; from++)
+			{
+				auto insn = code.code[from];
+				RenameSlots(code, insn, base.value());
+				if (HasTarget(insn.op))
+					insn.target = start + insn.target - first;
+				inlined.push_back(insn);
+			}
+
+			Splice(code, at, at + 1, inlined);
+			return true;
+		}
+		return false;
+	}
+
+	PassReport InlineFunctions(Bytecode& code, size_t budget)
+	{
+		// Inlined bodies call nothing, so every round has fewer calls left
+		PassReport report{};
+		while (InlineCall(code, budget))
+			report.rewritten++;
+		return report;
+	}
+}
+
+std::vector<PassReport> Optimize(Bytecode& code, const OptimizerOptions& options)
+{
+	struct Pass {
+		bool enabled{};
+		std::string_view name{};
+		std::function<PassReport(Bytecode&)> run{};
+	};
+	const Pass passes[]{
+		{ options.propagate_constants, "constant-propagation", &PropagateConstants },
+		{ options.propagate_copies, "copy-propagation", &PropagateCopies },
+		{ options.fold_constants, "constant-folding", &FoldConstants },
+		{ options.eliminate_dead_stores, "dead-store-elimination", &EliminateDeadStores },
+		{ options.hoist_invariants, "loop-invariant-code-motion", &HoistInvariants },
+		{ options.reduce_strength, "strength-reduction", &ReduceStrength },
+		{ options.unroll_loops, "loop-unrolling", &UnrollLoops },
+		{ options.inline_functions, "inlining", [&](Bytecode& code) { return InlineFunctions(code, options.inline_budget); } },
+	};
+
+	std::vector<PassReport> reports{};
+	for (const auto& pass : passes)
+	{
+		if (pass.enabled)
+			reports.push_back({ pass.name });
+	}
+
+	// Fused code jumps into the middle of superinstructions, which the analyses do not follow
+	if (IsFused(code))
+		return reports;
+
+	for (size_t round{}; round < max_rounds; round++)
+	{
+		bool changed = false;
+		auto report = reports.begin();
+		for (const auto& pass : passes)
+		{
+			if (!pass.enabled)
+				continue;
+
+			auto result = pass.run(code);
+			report->rewritten += result.rewritten;
+			report->removed += result.removed;
+			changed = changed || result.rewritten > 0 || result.removed > 0;
+			report++;
+		}
+
+		if (!changed)
+			break;
+	}
+	return reports;
+}
+
+}
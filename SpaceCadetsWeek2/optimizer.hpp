@@ -0,0 +1,36 @@
+#pragma once
+#include "common.hpp"
+#include "compiler.hpp"
+
+namespace bbones {
+
+// Passes run by Optimize. Each can be turned off on its own.
+struct OptimizerOptions {
+	bool propagate_constants{true};		// copy from, or a comparison with, a variable holding a known constant uses the constant
+	bool propagate_copies{true};		// reads of a copy read its source instead
+	bool fold_constants{true};			// arithmetic and conditions on constants, and the code they make unreachable
+	bool eliminate_dead_stores{true};	// writes to variables that are never read afterwards
+	bool hoist_invariants{true};		// arithmetic giving the same result on every iteration moves in front of the while
+	bool reduce_strength{true};			// multiplying a counter stepped by the loop becomes a running sum
+	bool unroll_loops{true};			// loops with a known, small number of iterations become that many copies of the body
+	bool inline_functions{true};		// calls to small functions that call nothing themselves become a copy of the body
+	size_t inline_budget{24};			// largest body, in instructions, that is inlined
+};
+
+struct PassReport {
+	std::string_view pass{};
+	size_t rewritten{};
+	size_t removed{};
+};
+
+// Dataflow optimisations over compiled bytecode, repeated until none of the
+// passes finds anything more to do. Returns one report per enabled pass.
+//
+// Output of print statements, faults and the final values of top level
+// variables (see VirtualMachine::GetGlobal) are unchanged. Divisions are
+// never removed, as the ones by zero trap.
+//
+// Runs before FuseSuperinstructions, fused code is left as it is.
+std::vector<PassReport> Optimize(Bytecode& code, const OptimizerOptions& options = {});
+
+}
@@ -0,0 +1,30 @@
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+
+namespace bbones {
+
+namespace {
+	std::atomic<size_t> parallel_threads{};
+}
+
+size_t GetParallelThreads()
+{
+	auto threads = parallel_threads.load();
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	return std::max<size_t>(threads, 1);
+}
+
+void SetParallelThreads(size_t threads)
+{
+	parallel_threads = threads;
+}
+
+size_t GetParallelChunks(size_t count, size_t min_grain)
+{
+	size_t chunks = std::max<size_t>(count / std::max<size_t>(min_grain, 1), 1);
+	return std::min(GetParallelThreads(), chunks);
+}
+
+}
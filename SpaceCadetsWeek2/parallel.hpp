@@ -0,0 +1,55 @@
+#pragma once
+#include "common.hpp"
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+namespace bbones {
+
+// Threads the front end splits work over. 0, the default, means one per
+// hardware thread.
+size_t GetParallelThreads();
+void SetParallelThreads(size_t threads);
+
+// How many pieces to split count items into so that each thread gets one,
+// without any piece being smaller than min_grain items
+size_t GetParallelChunks(size_t count, size_t min_grain);
+
+// Calls body(chunk, begin, end) for each of the chunks contiguous ranges
+// that [0, count) is split into, all at once and one per thread. The
+// calling thread takes the first chunk. The first exception thrown by a
+// chunk is rethrown once every chunk has finished.
+template <typename F>
+void ParallelFor(size_t chunks, size_t count, F&& body)
+{
+	chunks = std::max<size_t>(chunks, 1);
+	auto bounds = [&](size_t chunk) { return count * chunk / chunks; };
+	if (chunks == 1)
+		return body(size_t{ 0 }, size_t{ 0 }, count);
+
+	std::vector<std::exception_ptr> errors(chunks);
+	auto run = [&](size_t chunk) {
+		try {
+			body(chunk, bounds(chunk), bounds(chunk + 1));
+		}
+		catch (...) {
+			errors[chunk] = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> threads{};
+	threads.reserve(chunks - 1);
+	for (size_t chunk = 1; chunk < chunks; chunk++)
+		threads.emplace_back(run, chunk);
+	run(0);
+	for (auto& thread : threads)
+		thread.join();
+
+	for (const auto& error : errors)
+	{
+		if (error)
+			std::rethrow_exception(error);
+	}
+}
+
+}
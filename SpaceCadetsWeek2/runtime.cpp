@@ -1,4 +1,9 @@
 #include "runtime.hpp"
+#include "scan.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 
@@ -34,15 +39,164 @@ Variable& Variable::operator=(const Variable& x)
 	return *this;
 }
 
+namespace {
+	uint64_t NextFrameSerial()
+	{
+		static std::atomic<uint64_t> next{ 1 };
+		return next++;
+	}
+}
+
+// The copied frames hold other variables, so they are numbered afresh
+FrameStack::FrameStack(const FrameStack& other)
+	: m_frames{other.m_frames}, m_indices{other.m_indices}, m_top{other.m_top}
+{
+	for (size_t i{}; i < m_top; i++)
+		At(i) = other.At(i);
+	for (auto& frame : m_frames)
+		frame.serial = NextFrameSerial();
+}
+
+FrameStack::Binding& FrameStack::At(size_t index)
+{
+	while (index / chunk_size >= m_chunks.size())
+		m_chunks.push_back(std::make_unique<Binding[]>(chunk_size));
+	return m_chunks[index / chunk_size][index % chunk_size];
+}
+
+const FrameStack::Binding& FrameStack::At(size_t index) const
+{
+	return m_chunks[index / chunk_size][index % chunk_size];
+}
+
+size_t FrameStack::GetFrameEnd(size_t frame) const
+{
+	return (frame + 1 < m_frames.size()) ? m_frames[frame + 1].first : m_top;
+}
+
+size_t FrameStack::Push(size_t parent)
+{
+	m_frames.push_back({ m_top, parent, false, NextFrameSerial() });
+	return m_frames.size() - 1;
+}
+
+// Drop the innermost frame. Its bindings are left in place to be overwritten.
+void FrameStack::Pop()
+{
+	if (m_frames.back().indexed)
+		m_indices[m_frames.size() - 1].clear();
+	m_top = m_frames.back().first;
+	m_frames.pop_back();
+}
+
+StringMap<size_t>& FrameStack::GetIndex(size_t frame)
+{
+	if (m_indices.size() <= frame)
+		m_indices.resize(frame + 1);
+
+	auto& index = m_indices[frame];
+	if (!m_frames[frame].indexed)
+	{
+		// As with a scan, the first binding of a name wins
+		for (size_t i = m_frames[frame].first, end = GetFrameEnd(frame); i < end; i++)
+			index.emplace(At(i).name, i);
+		m_frames[frame].indexed = true;
+	}
+	return index;
+}
+
+size_t FrameStack::GetFrameCount() const
+{
+	return m_frames.size();
+}
+
+Variable* FrameStack::Find(size_t frame, std::string_view name)
+{
+	for (; frame != npos; frame = m_frames[frame].parent)
+	{
+		auto first = m_frames[frame].first;
+		auto end = GetFrameEnd(frame);
+		if (end - first > index_threshold)
+		{
+			auto& index = GetIndex(frame);
+			auto it = index.find(name);
+			if (it != index.end())
+				return &At(it->second).var;
+			continue;
+		}
+
+		for (size_t i = first; i < end; i++)
+		{
+			auto& binding = At(i);
+			if (binding.name == name)
+				return &binding.var;
+		}
+	}
+	return nullptr;
+}
+
+// Only the innermost frame can grow, the bindings of every other frame are
+// hemmed in by the frame above
+Variable* FrameStack::Create(size_t frame, std::string_view name)
+{
+	if (frame + 1 != m_frames.size())
+		throw std::logic_error{ "Tried to create variable \"" + std::string{ name } + "\" in a scope that is not the innermost one!" };
+
+	auto& binding = At(m_top);
+	binding.name = name;
+	binding.var = 0;
+	if (m_frames[frame].indexed)
+		m_indices[frame].emplace(binding.name, m_top);
+	m_top += 1;
+	return &binding.var;
+}
+
+void FrameStack::CopyFrame(size_t frame, const FrameStack& from, size_t from_frame)
+{
+	for (size_t i = from.m_frames[from_frame].first, end = from.GetFrameEnd(from_frame); i < end; i++)
+	{
+		const auto& binding = from.At(i);
+		*Create(frame, binding.name) = binding.var;
+	}
+}
+
+size_t FrameStack::GetDepth(size_t frame) const
+{
+	size_t depth{};
+	for (; frame != npos; frame = m_frames[frame].parent)
+		depth += 1;
+	return depth;
+}
+
+uint64_t FrameStack::GetSerial(size_t frame) const
+{
+	return m_frames[frame].serial;
+}
+
+std::string FrameStack::GetStateString(size_t frame)
+{
+	std::string result{};
+	for (; frame != npos; frame = m_frames[frame].parent)
+	{
+		for (size_t i = m_frames[frame].first, end = GetFrameEnd(frame); i < end; i++)
+		{
+			auto& binding = At(i);
+			result += binding.name + " is " + std::to_string(binding.var.GetValue()) + ". ";
+		}
+	}
+	return result;
+}
+
 std::optional<Scope* const> Scope::GetParentScope() const
 {
 	return (m_parent.has_value() && m_parent.value() != nullptr) ? m_parent : std::nullopt;
 }
 
-std::optional<Variable*> Scope::GetVariable(const std::string& name)
+std::optional<Variable*> Scope::GetVariable(std::string_view name)
 {
 	// Do we have a variable stored for this identifier?
-	if (m_vars.find(name) == m_vars.end())
+	auto* var = m_stack->Find(m_frame, name);
+	if (var == nullptr)
 	{
 		auto parent = GetParentScope();
 
@@ -52,31 +206,31 @@ std::optional<Variable*> Scope::GetVariable(const std::string& name)
 		return parent.value()->GetVariable(name);
 	}
 
-	return &m_vars.at(name);
+	return var;
 }
 
-Variable* Scope::CreateVariable(const std::string& name)
+Variable* Scope::CreateVariable(std::string_view name)
 {
 	if (GetVariable(name).has_value())
 	{
-		throw std::runtime_error{"Tried to create variable \"" + name + "\" when that variable already exists!"};
+		throw std::runtime_error{"Tried to create variable \"" + std::string{ name } + "\" when that variable already exists!"};
 	}
-	m_vars.insert({ name, Variable{} });
-	return &m_vars.at(name);
+	return m_stack->Create(m_frame, name);
 }
 
-Variable* Scope::CreateReference(const std::string& name, Variable* ref)
+Variable* Scope::CreateUncheckedVariable(std::string_view name)
+{
+	return m_stack->Create(m_frame, name);
+}
+
+Variable* Scope::CreateReference(std::string_view name, Variable* ref)
 {
 	return nullptr;
 }
 
 std::string Scope::GetStateString()
 {
-	std::string result{};
-	for (auto& [var_name, var] : m_vars)
-	{
-		result += var_name + " is " + std::to_string(var.GetValue()) + ". ";
-	}
+	std::string result = m_stack->GetStateString(m_frame);
 	auto parent = GetParentScope();
 	if (parent.has_value())
 		return result + parent.value()->GetStateString();
@@ -84,73 +238,92 @@ std::string Scope::GetStateString()
 }
 
 Scope::Scope(std::optional<Scope*> parent)
-	: m_parent{(parent.has_value() && parent.value() == nullptr) ? std::nullopt : parent}		// If the nullptr was passed in we treat this as nullopt
+	: m_own_stack{std::make_shared<FrameStack>()},
+	  m_parent{(parent.has_value() && parent.value() == nullptr) ? std::nullopt : parent}		// If the nullptr was passed in we treat this as nullopt
 {
+	m_stack = m_own_stack.get();
+	m_frame = m_stack->Push();
 }
 
 Scope::Scope(const Scope& copy_from, std::optional<Scope*> parent)
-	: m_vars{copy_from.m_vars}, m_parent{parent}
+	: Scope{parent}
+{
+	m_stack->CopyFrame(m_frame, *copy_from.m_stack, copy_from.m_frame);
+}
+
+Scope::Scope(FrameStack* stack, size_t frame)
+	: m_stack{stack}, m_frame{frame}
 {
 }
 
+uint64_t Scope::GetSerial() const
+{
+	return m_stack->GetSerial(m_frame);
+}
+
 size_t Scope::GetDepth()
 {
+	auto depth = m_stack->GetDepth(m_frame);
 	auto parent = GetParentScope();
 	if (!parent.has_value())
-		return 1;
-	return 1 + parent.value()->GetDepth();
+		return depth;
+	return depth + parent.value()->GetDepth();
 }
 
 ExecutionState::ExecutionState(const ExecutionState& other)
-	: m_ip{other.m_ip}, m_scope_stack{other.m_scope_stack}
-{
-}
-
-ExecutionState::ExecutionState(const std::vector<std::shared_ptr<Scope>>& scopes, const ExecutionCursor& ip)
-	: m_scope_stack{scopes}, m_ip{ip}
+	: m_frames{std::make_unique<FrameStack>(*other.m_frames)}, m_scope_depth{other.m_scope_depth},
+	  m_control_stack{other.m_control_stack}, m_ip{other.m_ip}
 {
+	for (size_t i{}; i < m_scope_depth; i++)
+		m_scopes.emplace_back(m_frames.get(), i);
 }
 
 ExecutionState ExecutionState::DeepCopy()
 {
-	std::vector<std::shared_ptr<Scope>> scope_copies{};
-	for (auto scope : m_scope_stack)
-	{
-		auto parent = (scope_copies.size() > 0) ? scope_copies.back() : nullptr;
-		std::shared_ptr<Scope> scope_copy = std::shared_ptr<Scope>{ new Scope{*scope.get(), parent.get()}};
-		scope_copies.push_back(scope_copy);
-	}
-
-	return { scope_copies, m_ip };
+	return ExecutionState{ *this };
 }
 
 ExecutionState::ExecutionState()
+	: m_frames{std::make_unique<FrameStack>()}
 {
 	PushScope();
 }
 
 Scope* const ExecutionState::PushScope()
 {
-	m_scope_stack.push_back(std::shared_ptr<Scope>{new Scope{ GetScope() }});
+	return PushScope((m_scope_depth > 0) ? m_scope_depth - 1 : FrameStack::npos);
+}
+
+Scope* const ExecutionState::PushScope(size_t parent)
+{
+	auto frame = m_frames->Push(parent);
+	if (m_scopes.size() <= frame)
+		m_scopes.emplace_back(m_frames.get(), frame);
+
+	m_scope_depth += 1;
 	return GetScope();
 }
 
 void ExecutionState::PopScope()
 {
-	m_scope_stack.pop_back();
+	m_frames->Pop();
+	m_scope_depth -= 1;
 }
 
 Scope* const ExecutionState::GetScope()
 {
-	if (m_scope_stack.empty())
+	if (m_scope_depth == 0)
 		return nullptr;
 
-	return m_scope_stack.back().get();
+	return &m_scopes[m_scope_depth - 1];
 }
 
-std::shared_ptr<Scope> ExecutionState::GetGlobalScope()
+Scope* const ExecutionState::GetGlobalScope()
 {
-	return m_scope_stack[0];
+	if (m_scope_depth == 0)
+		return nullptr;
+
+	return &m_scopes.front();
 }
 
 ExecutionCursor ExecutionState::GetCursor()
@@ -168,6 +341,82 @@ void ExecutionState::SetCursor(const ExecutionCursor& pos)
 	m_ip = pos;
 }
 
+Scope* const ExecutionState::EnterBlock(const ExecutionCursor& end, const ExecutionCursor& resume, bool with_scope)
+{
+	m_control_stack.push_back({ end, resume, with_scope });
+	return with_scope ? PushScope() : GetScope();
+}
+
+void ExecutionState::LeaveBlock()
+{
+	auto frame = std::move(m_control_stack.back());
+	m_control_stack.pop_back();
+	if (frame.has_scope)
+		PopScope();
+	SetCursor(frame.resume);
+	for (const auto& on_leave : frame.on_leave)
+		on_leave();
+}
+
+Scope* const ExecutionState::EnterCall(ControlFrame call)
+{
+	call.has_scope = true;
+	call.is_call = true;
+	m_control_stack.push_back(std::move(call));
+	return PushScope(FrameStack::npos);
+}
+
+// Leave every block of the innermost call without finishing it, returning
+// the call's own frame so that another call can finish in its place
+ControlFrame ExecutionState::LeaveCall()
+{
+	while (!m_control_stack.empty())
+	{
+		auto frame = std::move(m_control_stack.back());
+		m_control_stack.pop_back();
+		if (frame.has_scope)
+			PopScope();
+		if (frame.is_call)
+			return frame;
+	}
+	throw std::logic_error{ "Tried to return from a function when no function has been called!" };
+}
+
+// Whether running on from `next` would do nothing but leave blocks until the
+// innermost call returns. Only the ends of ifs resume just past themselves,
+// leaving a while goes back to its test.
+bool ExecutionState::IsTailPosition(const ExecutionCursor& next) const
+{
+	auto at = next.GetOrdinal();
+	for (auto frame = m_control_stack.rbegin(); frame != m_control_stack.rend(); frame++)
+	{
+		if (frame->end.GetOrdinal() != at)
+			return false;
+		if (frame->is_call)
+			return true;
+		at = frame->resume.GetOrdinal();
+	}
+	return false;
+}
+
+ControlFrame* const ExecutionState::GetControlFrame()
+{
+	if (m_control_stack.empty())
+		return nullptr;
+
+	return &m_control_stack.back();
+}
+
+size_t ExecutionState::GetControlDepth() const
+{
+	return m_control_stack.size();
+}
+
+size_t ExecutionState::GetStackDepth() const
+{
+	return m_scope_depth;
+}
+
 std::string ExecutionState::GetStateString()
 {
 	return "IP is " + std::to_string(GetCursor().GetOrdinal()) + ". " + GetScope()->GetStateString();
@@ -203,51 +452,267 @@ size_t ExecutionCursor::GetOrdinal() const
 	return m_ord;
 }
 
-std::string BaseProgram::CleanInstruction(const std::string& insn)
+// Trim whitespace from either side of the statement in [begin, end)
+BaseProgram::StatementSpan BaseProgram::CleanInstruction(size_t begin, size_t end) const
+{
+	auto text = GetText();
+	while (begin < end && IsWhitespace(text[begin]))
+		begin += 1;
+	while (end > begin && IsWhitespace(text[end - 1]))
+		end -= 1;
+
+	return { begin, end - begin };
+}
+
+// Split the program into statements once so that fetching is O(1). Large
+// programs are split into chunks that are scanned on threads of their own,
+// once to count the statements in each chunk and again to fill them in.
+void BaseProgram::IndexStatements()
+{
+	m_statements.clear();
+	auto text = GetText();
+
+	// Moves a line count kept for one offset to another, in either direction
+	auto move_line = [&](size_t& line, size_t& counted, size_t offset) {
+		if (offset >= counted)
+			line += std::count(text.begin() + counted, text.begin() + offset, '\n');
+		else
+			line -= std::count(text.begin() + offset, text.begin() + counted, '\n');
+		counted = offset;
+	};
+
+	// Passes add the span of every statement ending in [begin, end), given
+	// where the statement in progress at begin started and the line begin is
+	// on. Separators are found a block at a time so that their offsets never
+	// take more memory than the block does. Returns where the statement in
+	// progress at end started.
+	constexpr size_t block_size = 1 << 16;
+	auto scan = [&](size_t begin, size_t end, size_t start, size_t line, auto&& add) {
+		std::vector<size_t> separators{};
+		auto counted = begin;
+		for (size_t block = begin; block < end; block += block_size)
+		{
+			separators.clear();
+			FindAll(text.substr(block, std::min(block_size, end - block)), ';', separators);
+			for (auto offset : separators)
+			{
+				auto span = CleanInstruction(start, block + offset);
+				move_line(line, counted, span.offset);
+				span.line = line;
+				add(span);
+				start = block + offset + 1;
+			}
+		}
+		return start;
+	};
+
+	size_t last_pos = 0;
+	auto chunks = GetParallelChunks(text.size(), 1 << 18);
+	if (chunks == 1)
+	{
+		// Large programs are generated and fairly uniform, so the first block
+		// gives a good guess at how many statements there are in total
+		std::vector<size_t> sample{};
+		FindAll(text.substr(0, block_size), ';', sample);
+		m_statements.reserve(sample.size() * (text.size() / block_size + 1));
+
+		last_pos = scan(0, text.size(), 0, 1, [&](const StatementSpan& span) { m_statements.push_back(span); });
+	}
+	else
+	{
+		struct ChunkInfo {
+			size_t separators{};
+			size_t newlines{};
+			size_t last_separator{std::string_view::npos};
+
+			// Filled in once every chunk has been counted
+			size_t first_statement{};
+			size_t statement_start{};
+			size_t first_line{};
+		};
+
+		std::vector<ChunkInfo> info(chunks);
+		ParallelFor(chunks, text.size(), [&](size_t chunk, size_t begin, size_t end) {
+			std::vector<size_t> separators{};
+			for (size_t block = begin; block < end; block += block_size)
+			{
+				separators.clear();
+				FindAll(text.substr(block, std::min(block_size, end - block)), ';', separators);
+				info[chunk].separators += separators.size();
+				if (!separators.empty())
+					info[chunk].last_separator = block + separators.back();
+			}
+			info[chunk].newlines = std::count(text.begin() + begin, text.begin() + end, '\n');
+		});
+
+		size_t statements = 0;
+		size_t line = 1;
+		for (auto& chunk : info)
+		{
+			chunk.first_statement = statements;
+			chunk.statement_start = last_pos;
+			chunk.first_line = line;
+			statements += chunk.separators;
+			line += chunk.newlines;
+			if (chunk.last_separator != std::string_view::npos)
+				last_pos = chunk.last_separator + 1;
+		}
+
+		m_statements.resize(statements);
+		ParallelFor(chunks, text.size(), [&](size_t chunk, size_t begin, size_t end) {
+			auto next = info[chunk].first_statement;
+			scan(begin, end, info[chunk].statement_start, info[chunk].first_line, [&](const StatementSpan& span) { m_statements[next++] = span; });
+		});
+	}
+
+	// Trailing statement without a terminating semicolon
+	auto trailing = CleanInstruction(last_pos, text.size());
+	if (trailing.length > 0)
+	{
+		size_t line = m_statements.empty() ? 1 : m_statements.back().line;
+		size_t counted = m_statements.empty() ? 0 : m_statements.back().offset;
+		move_line(line, counted, trailing.offset);
+		trailing.line = line;
+		m_statements.push_back(trailing);
+	}
+}
+
+std::string_view BaseProgram::GetText() const
 {
-	static const std::unordered_set<char> whitespace{ ' ', '\n', '\r', '\t' };
-	int l = 0;
-	while (whitespace.contains(insn[l]))
-		l += 1;
-	int r = insn.size() - 1;
-	while (whitespace.contains(insn[r]))
-		r -= 1;
+	if (m_mapping)
+		return m_mapping->GetView();
+	return m_text;
+}
 
-	if (l >= r)
-		return "";
-	return insn.substr(l, (r - l + 1));
+BaseProgram::BaseProgram(std::string program_text)
+	: m_text{std::move(program_text)}
+{
+	IndexStatements();
 }
 
-BaseProgram::BaseProgram(const std::string& program_text)
-	: m_text{program_text}
+BaseProgram::BaseProgram(MappedFile file)
+	: m_mapping{std::make_shared<const MappedFile>(std::move(file))}
 {
+	IndexStatements();
 }
 
-// O(n) fail :facepalm:
 // Get the nth statement from file
-std::optional<std::string> BaseProgram::Fetch(const ExecutionCursor& ip)
+std::optional<std::string_view> BaseProgram::Fetch(const ExecutionCursor& ip)
 {
-	int num = 0;
-	size_t last_pos = 0;
-	size_t pos = 0;
+	if (ip.GetOrdinal() >= m_statements.size())
+		return std::nullopt;
 
-	for (pos = m_text.find(';'); pos != std::string::npos; pos = m_text.find(';', last_pos))
-	{
-		if (ip.GetOrdinal() == num)
-			return CleanInstruction(m_text.substr(last_pos, (pos-last_pos)));
+	auto span = m_statements[ip.GetOrdinal()];
+	return GetText().substr(span.offset, span.length);
+}
 
-		last_pos = pos + 1;
-		num += 1;
-	}
+size_t BaseProgram::GetStatementCount() const
+{
+	return m_statements.size();
+}
+
+size_t BaseProgram::GetLine(const ExecutionCursor& ip) const
+{
+	if (ip.GetOrdinal() >= m_statements.size())
+		return 0;
+	return m_statements[ip.GetOrdinal()].line;
+}
 
-	if (ip.GetOrdinal() == num)
+std::optional<ExecutionCursor> BlockTable::ToCursor(size_t ordinal)
+{
+	if (ordinal == npos)
+		return std::nullopt;
+	return ExecutionCursor{ ordinal };
+}
+
+BlockTable::BlockTable(IProgram* program)
+{
+	if (program == nullptr)
+		return;
+
+	struct OpenBlock {
+		size_t opener{};
+		size_t last_branch{npos};		// only set for if blocks
+
+		// Body that statements are currently being added to
+		size_t GetBody() const { return (last_branch != npos) ? last_branch : opener; }
+	};
+	std::vector<OpenBlock> open_blocks{};
+
+	for (size_t ordinal = 0; auto statement = program->Fetch(ordinal); ordinal++)
 	{
-		auto substr = m_text.substr(last_pos, m_text.size());
-		if (substr.size() > 0)
-			return CleanInstruction(substr);
+		m_links.push_back({});
+
+		auto keyword = FirstWord(statement.value());
+		if (keyword == "while" || keyword == "function")
+		{
+			open_blocks.push_back({ ordinal });
+		}
+		else if (keyword == "if")
+		{
+			open_blocks.push_back({ ordinal, ordinal });
+		}
+		else if (keyword == "elif" || keyword == "else")
+		{
+			// Outside of an if these are no-ops
+			if (!open_blocks.empty() && open_blocks.back().last_branch != npos)
+			{
+				m_links[open_blocks.back().last_branch].next_branch = ordinal;
+				open_blocks.back().last_branch = ordinal;
+			}
+		}
+		else if (keyword == "init" || keyword == "set")
+		{
+			// Conservatively, a set may be the first assignment and so create its variable
+			if (!open_blocks.empty())
+				m_links[open_blocks.back().GetBody()].declares = true;
+		}
+		else if (keyword == "end" && !open_blocks.empty())
+		{
+			auto block = open_blocks.back();
+			open_blocks.pop_back();
+
+			m_links[block.opener].end = ordinal;
+			m_links[ordinal].opener = block.opener;
+			if (block.last_branch != npos)
+				m_links[block.last_branch].next_branch = ordinal;
+		}
 	}
+}
+
+std::optional<ExecutionCursor> BlockTable::GetEnd(const ExecutionCursor& opener) const
+{
+	if (opener.GetOrdinal() >= m_links.size())
+		return std::nullopt;
+	return ToCursor(m_links[opener.GetOrdinal()].end);
+}
 
-	return std::nullopt;
+std::optional<ExecutionCursor> BlockTable::GetNextBranch(const ExecutionCursor& branch) const
+{
+	if (branch.GetOrdinal() >= m_links.size())
+		return std::nullopt;
+	return ToCursor(m_links[branch.GetOrdinal()].next_branch);
+}
+
+std::optional<ExecutionCursor> BlockTable::GetOpener(const ExecutionCursor& end) const
+{
+	if (end.GetOrdinal() >= m_links.size())
+		return std::nullopt;
+	return ToCursor(m_links[end.GetOrdinal()].opener);
+}
+
+// Whether entering the body that starts after this while/if/elif/else might
+// create a variable. Declarations in nested blocks belong to those blocks.
+bool BlockTable::DeclaresVariables(const ExecutionCursor& body) const
+{
+	if (body.GetOrdinal() >= m_links.size())
+		return true;
+	return m_links[body.GetOrdinal()].declares;
+}
+
+size_t BlockTable::GetStatementCount() const
+{
+	return m_links.size();
 }
 
 std::optional<BaseProgram*> CreateProgramFromFile(const std::string& path)
@@ -255,13 +720,26 @@ std::optional<BaseProgram*> CreateProgramFromFile(const std::string& path)
 	if (!std::filesystem::exists(path))
 		return std::nullopt;
 
-    std::ifstream infile{path};
+	// Statements are read straight out of the mapping
+	auto mapped = MappedFile::Open(path);
+	if (mapped.has_value())
+		return { new BaseProgram{ std::move(mapped.value()) } };
+
+	// Named pipes and the like can still be read through
+	std::ifstream infile{ path, std::ios::binary };
+	if (!infile)
+		return std::nullopt;
+	return { CreateProgramFromStream(infile) };
+}
+
+BaseProgram* CreateProgramFromStream(std::istream& input)
+{
 	std::string file_content{};
-	std::string buff{};
-	while (std::getline(infile, buff))
-		file_content.append(buff);
-		
-	return { new BaseProgram{ file_content } };
+	std::array<char, 1 << 16> buffer{};
+	while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0)
+		file_content.append(buffer.data(), static_cast<size_t>(input.gcount()));
+
+	return new BaseProgram{ std::move(file_content) };
 }
 
 }
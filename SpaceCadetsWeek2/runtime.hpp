@@ -1,5 +1,9 @@
 #pragma once
 #include "common.hpp"
+#include "mapped_file.hpp"
+#include "tokens.hpp"
+#include <deque>
+#include <iosfwd>
 
 namespace bbones {
 
@@ -17,9 +21,65 @@ public:
 	Variable& operator=(const Variable& x);
 };
 
+// Variables of a stack of scopes stored back to back. Opening a scope marks
+// the current top and closing it rewinds to the mark, so once the stack has
+// grown to a program's deepest point scopes cost no allocations. Bindings live
+// in fixed size chunks so pointers to variables stay valid as the stack grows.
+// Frames with more than a few bindings are searched through a hash index,
+// built on the first lookup and dropped when the frame is popped.
+class FrameStack {
+public:
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+private:
+	struct Binding {
+		std::string name{};
+		Variable var{};
+	};
+
+	struct Frame {
+		size_t first{};				// first binding of the frame
+		size_t parent{npos};		// index of the enclosing frame
+		bool indexed{};				// m_indices holds every binding of the frame
+		uint64_t serial{};			// unique to this push of the frame, in any stack
+	};
+
+	static constexpr size_t chunk_size = 64;
+	static constexpr size_t index_threshold = 16;		// frames this small are scanned
+
+	std::vector<std::unique_ptr<Binding[]>> m_chunks{};
+	std::vector<Frame> m_frames{};
+	std::vector<StringMap<size_t>> m_indices{};		// name to binding, per frame, kept across pops for reuse
+	size_t m_top{};
+
+	Binding& At(size_t index);
+	const Binding& At(size_t index) const;
+	size_t GetFrameEnd(size_t frame) const;
+	StringMap<size_t>& GetIndex(size_t frame);
+
+public:
+	FrameStack() = default;
+	FrameStack(const FrameStack& other);
+
+	size_t Push(size_t parent = npos);
+	void Pop();
+	size_t GetFrameCount() const;
+
+	Variable* Find(size_t frame, std::string_view name);
+	Variable* Create(size_t frame, std::string_view name);
+	void CopyFrame(size_t frame, const FrameStack& from, size_t from_frame);
+	size_t GetDepth(size_t frame) const;
+	uint64_t GetSerial(size_t frame) const;
+	std::string GetStateString(size_t frame);
+};
+
+// A view onto one frame of a FrameStack. Scopes created on their own get a
+// stack of their own and may be chained to a parent scope by pointer.
 class Scope {
 private:
-	std::unordered_map<std::string, Variable> m_vars{};			
+	std::shared_ptr<FrameStack> m_own_stack{};
+	FrameStack* m_stack{};
+	size_t m_frame{};
 	std::optional<Scope*> m_parent{};
 
 	std::optional<Scope* const> GetParentScope() const;
@@ -27,11 +87,16 @@ private:
 public:
 	Scope(std::optional<Scope*> parent = std::nullopt);
 	Scope(const Scope& copy_from, std::optional<Scope*> parent = std::nullopt);
+	Scope(FrameStack* stack, size_t frame);
 
-	std::optional<Variable*> GetVariable(const std::string& name);
-	Variable* CreateVariable(const std::string& name);
-	Variable* CreateReference(const std::string& name, Variable* ref);
+	std::optional<Variable*> GetVariable(std::string_view name);
+	Variable* CreateVariable(std::string_view name);
+	// For names known not to be visible from this scope, skips checking
+	Variable* CreateUncheckedVariable(std::string_view name);
+	Variable* CreateReference(std::string_view name, Variable* ref);
 	size_t GetDepth();
+	// Tells apart the frames that have been open at the same depth
+	uint64_t GetSerial() const;
 
 	// quick fix
 	std::string GetStateString();
@@ -61,29 +126,59 @@ public:
 	ExecutionCursor GetTop() const;
 };
 
+// A block (loop body, taken branch or function body) that execution is
+// currently inside of. The block is left when the cursor reaches its end.
+struct ControlFrame {
+	ExecutionCursor end{};			// statement that terminates the block (end, or the next elif/else)
+	ExecutionCursor resume{};		// where execution continues once the block is left
+	bool has_scope{true};			// false if the block runs in the enclosing scope
+	bool is_call{};					// function body, whose scope cannot see the caller's
+	std::vector<std::function<void()>> on_leave{};		// run once the end is reached, but not if the block throws
+};
+
 class ExecutionState {
 private:
-	std::vector<std::shared_ptr<Scope>> m_scope_stack{};
+	// Frame i of the stack is scope i, whose parent is scope i - 1. Views are
+	// kept around once created so that pushing a scope reuses them.
+	std::unique_ptr<FrameStack> m_frames{};
+	std::deque<Scope> m_scopes{};
+	size_t m_scope_depth{};
+	std::vector<ControlFrame> m_control_stack{};
 	ExecutionCursor m_ip;
 
+	Scope* const PushScope(size_t parent);
+
 public:
 	ExecutionState();
-	ExecutionState(
-		const std::vector<std::shared_ptr<Scope>>& scopes, 
-		const ExecutionCursor& ip
-	);
 	ExecutionState(const ExecutionState& other);
 
 	ExecutionState DeepCopy();
 	Scope* const PushScope();
 	void PopScope();
 	Scope* const GetScope();
-	std::shared_ptr<Scope> GetGlobalScope();
+	Scope* const GetGlobalScope();
 
 	ExecutionCursor GetCursor();
 	void IncrementCursor();
 	void SetCursor(const ExecutionCursor& pos);
 
+	// Blocks get a scope of their own for as long as they are entered, unless
+	// they declare nothing and can share the enclosing one
+	Scope* const EnterBlock(const ExecutionCursor& end, const ExecutionCursor& resume, bool with_scope = true);
+	void LeaveBlock();
+
+	// Function calls are blocks like any other, so calling never recurses on
+	// the host stack. A call whose caller would return straight after it
+	// (see IsTailPosition) replaces the caller's blocks instead of adding to them.
+	Scope* const EnterCall(ControlFrame call);
+	ControlFrame LeaveCall();
+	bool IsTailPosition(const ExecutionCursor& next) const;
+
+	ControlFrame* const GetControlFrame();
+	size_t GetControlDepth() const;
+	// Scopes open across every call, kept as a count rather than walking the chain
+	size_t GetStackDepth() const;
+
 	// quick fix 
 	std::string GetStateString();
 };
@@ -91,23 +186,80 @@ public:
 class IProgram {
 public:
 	virtual ~IProgram() = default;
-	virtual std::optional<std::string> Fetch(const ExecutionCursor& ip) = 0;
+	// Large programs are fetched from several threads at once while loading
+	virtual std::optional<std::string_view> Fetch(const ExecutionCursor& ip) = 0;
 };
 
 class BaseProgram : public IProgram {
 private:
+	// Location of a cleaned statement within the program text
+	struct StatementSpan {
+		size_t offset{};
+		size_t length{};
+		size_t line{};
+	};
+
+	// The text is either owned, or read in place from a mapped file
 	std::string m_text{};
+	std::shared_ptr<const MappedFile> m_mapping{};
+	std::vector<StatementSpan> m_statements{};
 
-	std::string CleanInstruction(const std::string& insn);
+	std::string_view GetText() const;
+	StatementSpan CleanInstruction(size_t begin, size_t end) const;
+	void IndexStatements();
 
 public:
-	BaseProgram(const std::string& program_text);
+	BaseProgram(std::string program_text);
+	BaseProgram(MappedFile file);
 	virtual ~BaseProgram() = default;
 
-	std::optional<std::string> Fetch(const ExecutionCursor& ip) override;
+	// Views returned remain valid for the lifetime of the program
+	std::optional<std::string_view> Fetch(const ExecutionCursor& ip) override;
+	size_t GetStatementCount() const;
+	// Line the statement starts on, counting from 1
+	size_t GetLine(const ExecutionCursor& ip) const;
+};
+
+// Pairs every block opener (while, if, function) with its end statement and
+// chains the branches of an if together. Built once per program so that
+// skipping a block is a single cursor assignment.
+class BlockTable {
+private:
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+	struct Links {
+		size_t end{npos};				// opener -> matching end
+		size_t next_branch{npos};		// if/elif/else -> next elif/else/end
+		size_t opener{npos};			// end -> opener
+		bool declares{};				// while/if/elif/else body directly contains init or set
+	};
+
+	std::vector<Links> m_links{};
+
+	static std::optional<ExecutionCursor> ToCursor(size_t ordinal);
+
+public:
+	BlockTable() = default;
+	BlockTable(IProgram* program);
+
+	std::optional<ExecutionCursor> GetEnd(const ExecutionCursor& opener) const;
+	std::optional<ExecutionCursor> GetNextBranch(const ExecutionCursor& branch) const;
+	std::optional<ExecutionCursor> GetOpener(const ExecutionCursor& end) const;
+	bool DeclaresVariables(const ExecutionCursor& body) const;
+	size_t GetStatementCount() const;
+};
+
+// What is known, before a program runs, about the variables a statement
+// names (see Analyzer). Holds every time the statement is reached.
+enum class VariableAccess : uint8_t {
+	Unchecked,		// nothing is known, lookups check as usual
+	Existing,		// every variable the statement names is visible
+	New,			// the variable the statement declares is not visible yet
 };
 
 // INTERFACE fn
 std::optional<BaseProgram*> CreateProgramFromFile(const std::string& path);
+// Reads until the end of the stream, for programs piped in rather than saved
+BaseProgram* CreateProgramFromStream(std::istream& input);
 
 }
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "scan.hpp"
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BBONES_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BBONES_TARGET_AVX2
+#else
+#define BBONES_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace bbones {
+
+namespace {
+	void FindAllScalar(std::string_view text, char needle, size_t from, std::vector<size_t>& offsets)
+	{
+		for (size_t pos = text.find(needle, from); pos != std::string_view::npos; pos = text.find(needle, pos + 1))
+			offsets.push_back(pos);
+	}
+
+#ifdef BBONES_SCAN_X86
+	// Turn a mask of matching bytes into offsets, lowest bit first
+	inline void PushMatches(uint32_t mask, size_t base, std::vector<size_t>& offsets)
+	{
+		while (mask != 0)
+		{
+			offsets.push_back(base + std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+	}
+
+	void FindAllSse2(std::string_view text, char needle, std::vector<size_t>& offsets)
+	{
+		auto pattern = _mm_set1_epi8(needle);
+		size_t pos = 0;
+		for (; pos + 16 <= text.size(); pos += 16)
+		{
+			auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+			auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern)));
+			PushMatches(mask, pos, offsets);
+		}
+		FindAllScalar(text, needle, pos, offsets);
+	}
+
+	BBONES_TARGET_AVX2 void FindAllAvx2(std::string_view text, char needle, std::vector<size_t>& offsets)
+	{
+		auto pattern = _mm256_set1_epi8(needle);
+		size_t pos = 0;
+		for (; pos + 32 <= text.size(); pos += 32)
+		{
+			auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+			auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pattern)));
+			PushMatches(mask, pos, offsets);
+		}
+		FindAllScalar(text, needle, pos, offsets);
+	}
+
+	bool DetectAvx2()
+	{
+#ifdef _MSC_VER
+		// The CPU has to support AVX2 and the OS has to save the YMM registers
+		int info[4]{};
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool os_saves_avx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+		__cpuidex(info, 7, 0);
+		return os_saves_avx && (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+bool IsSupported(ScanKernel kernel)
+{
+	switch (kernel)
+	{
+	case ScanKernel::Scalar:
+		return true;
+#ifdef BBONES_SCAN_X86
+	case ScanKernel::Sse2:
+		return true;
+	case ScanKernel::Avx2:
+	{
+		static const bool avx2 = DetectAvx2();
+		return avx2;
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+ScanKernel GetBestScanKernel()
+{
+	static const ScanKernel best = IsSupported(ScanKernel::Avx2) ? ScanKernel::Avx2
+		: IsSupported(ScanKernel::Sse2) ? ScanKernel::Sse2
+		: ScanKernel::Scalar;
+	return best;
+}
+
+std::string_view GetScanKernelName(ScanKernel kernel)
+{
+	static constexpr std::string_view names[]{ "scalar", "sse2", "avx2" };
+	return names[static_cast<size_t>(kernel)];
+}
+
+void FindAll(std::string_view text, char needle, std::vector<size_t>& offsets, ScanKernel kernel)
+{
+	if (!IsSupported(kernel))
+		throw std::runtime_error("Error: the " + std::string{ GetScanKernelName(kernel) } + " scan kernel is not supported here.");
+
+	switch (kernel)
+	{
+#ifdef BBONES_SCAN_X86
+	case ScanKernel::Sse2:
+		return FindAllSse2(text, needle, offsets);
+	case ScanKernel::Avx2:
+		return FindAllAvx2(text, needle, offsets);
+#endif
+	default:
+		return FindAllScalar(text, needle, 0, offsets);
+	}
+}
+
+}
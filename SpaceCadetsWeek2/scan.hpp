@@ -0,0 +1,24 @@
+#pragma once
+#include "common.hpp"
+#include <string_view>
+
+namespace bbones {
+
+// Ways of searching program text for a byte. The vector kernels are only
+// built for x86-64, where SSE2 is always present and AVX2 is detected when
+// the program starts.
+enum class ScanKernel : uint8_t {
+	Scalar,
+	Sse2,
+	Avx2,
+};
+
+bool IsSupported(ScanKernel kernel);
+// The widest kernel the CPU supports
+ScanKernel GetBestScanKernel();
+std::string_view GetScanKernelName(ScanKernel kernel);
+
+// Append the offset of every occurrence of needle in text, in order
+void FindAll(std::string_view text, char needle, std::vector<size_t>& offsets, ScanKernel kernel = GetBestScanKernel());
+
+}
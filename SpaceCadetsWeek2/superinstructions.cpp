@@ -0,0 +1,68 @@
+#include "superinstructions.hpp"
+
+namespace bbones {
+
+namespace {
+	// Sequences are matched on the instructions as compiled, before any fusion
+	std::optional<Instruction> MatchSequence(const std::vector<Instruction>& code, size_t at)
+	{
+		const auto& first = code[at];
+		const auto* second = (at + 1 < code.size()) ? &code[at + 1] : nullptr;
+		const auto* third = (at + 2 < code.size()) ? &code[at + 2] : nullptr;
+
+		// incr/decr n; end;
+		if ((first.op == OpCode::Incr || first.op == OpCode::Decr) && second != nullptr && second->op == OpCode::End
+			&& code[second->target].op == OpCode::While)
+		{
+			return Instruction{ OpCode::StepEndWhile, {}, first.a, (first.op == OpCode::Incr) ? 1 : -1, {}, second->target };
+		}
+
+		// add l r into t; copy r to l; copy t to r;
+		if (first.op == OpCode::Add && third != nullptr
+			&& second->op == OpCode::Copy && second->a == first.b && second->c == first.a
+			&& third->op == OpCode::Copy && third->a == first.c && third->c == first.b)
+		{
+			return Instruction{ OpCode::AddRotate, {}, first.a, first.b, first.c };
+		}
+
+		// copy a to b; copy c to d;
+		if (first.op == OpCode::Copy && second != nullptr && second->op == OpCode::Copy)
+			return Instruction{ OpCode::CopyCopy, {}, first.a, second->a, first.c, second->c };
+
+		// end; of a while loop
+		if (first.op == OpCode::End && code[first.target].op == OpCode::While)
+			return Instruction{ OpCode::EndWhile, {}, {}, {}, {}, first.target };
+
+		return std::nullopt;
+	}
+
+	size_t GetSequenceLength(OpCode op)
+	{
+		switch (op)
+		{
+		case OpCode::StepEndWhile:
+		case OpCode::CopyCopy:	return 2;
+		case OpCode::AddRotate:	return 3;
+		default:				return 1;
+		}
+	}
+}
+
+void FuseSuperinstructions(Bytecode& code)
+{
+	auto original = code.code;
+	for (size_t at = 0; at < original.size(); )
+	{
+		auto fused = MatchSequence(original, at);
+		if (!fused.has_value())
+		{
+			at += 1;
+			continue;
+		}
+
+		code.code[at] = fused.value();
+		at += GetSequenceLength(fused.value().op);
+	}
+}
+
+}
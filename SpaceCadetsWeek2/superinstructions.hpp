@@ -0,0 +1,21 @@
+#pragma once
+#include "common.hpp"
+#include "compiler.hpp"
+
+namespace bbones {
+
+// Rewrites frequent instruction sequences into single superinstructions so
+// the VM dispatches once instead of once per statement. The table of
+// sequences started from profiles of the example programs (see
+// VirtualMachine::Profile):
+//
+//	decr n; end; while ...		the back edge of a counting loop
+//	copy a to b; copy c to d;	shuffling values between variables
+//	add l r into t; copy r to l; copy t to r;	the step of the fib loop
+//
+// Fusion happens in place. The superinstruction replaces the first
+// instruction of its sequence and skips the rest, which are left untouched
+// so that jumps into the middle of a sequence still work.
+void FuseSuperinstructions(Bytecode& code);
+
+}
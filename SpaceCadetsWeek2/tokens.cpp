@@ -0,0 +1,104 @@
+#include "tokens.hpp"
+#include <algorithm>
+
+namespace bbones {
+
+size_t StringHash::operator()(std::string_view text) const
+{
+	return std::hash<std::string_view>{}(text);
+}
+
+Tokens::Tokens(std::initializer_list<std::string_view> words)
+{
+	for (auto word : words)
+		push_back(word);
+}
+
+void Tokens::push_back(std::string_view word)
+{
+	if (m_size < inline_capacity)
+	{
+		m_inline[m_size++] = word;
+		return;
+	}
+
+	if (m_spilled.empty())
+		m_spilled.assign(m_inline.begin(), m_inline.end());
+	m_spilled.push_back(word);
+	m_size++;
+}
+
+size_t Tokens::size() const
+{
+	return m_size;
+}
+
+bool Tokens::empty() const
+{
+	return m_size == 0;
+}
+
+std::string_view Tokens::operator[](size_t index) const
+{
+	return begin()[index];
+}
+
+const std::string_view* Tokens::begin() const
+{
+	return m_spilled.empty() ? m_inline.data() : m_spilled.data();
+}
+
+const std::string_view* Tokens::end() const
+{
+	return begin() + m_size;
+}
+
+Tokens Tokens::From(size_t from) const
+{
+	Tokens result{};
+	for (size_t i = from; i < m_size; i++)
+		result.push_back((*this)[i]);
+	return result;
+}
+
+std::vector<std::string> Tokens::ToStrings(size_t from) const
+{
+	std::vector<std::string> result{};
+	if (from < m_size)
+		result.reserve(m_size - from);
+	for (size_t i = from; i < m_size; i++)
+		result.emplace_back((*this)[i]);
+	return result;
+}
+
+bool IsWhitespace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+Tokens Tokenize(std::string_view statement)
+{
+	Tokens result{};
+	size_t l = 0;
+	for (size_t r = 0; r < statement.size(); r++)
+	{
+		if (IsWhitespace(statement[r]))
+		{
+			if (r != l)
+				result.push_back(statement.substr(l, r - l));
+			l = r + 1;
+		}
+	}
+	if (l < statement.size())
+		result.push_back(statement.substr(l));
+
+	return result;
+}
+
+std::string_view FirstWord(std::string_view statement)
+{
+	auto end = std::find_if(statement.begin(), statement.end(), IsWhitespace);
+	return statement.substr(0, end - statement.begin());
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "common.hpp"
+#include <array>
+#include <initializer_list>
+#include <string_view>
+
+namespace bbones {
+
+// Lets maps keyed by std::string be searched with a std::string_view
+// without building a temporary key.
+struct StringHash {
+	using is_transparent = void;
+	size_t operator()(std::string_view text) const;
+};
+
+template <typename T>
+using StringMap = std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
+using StringSet = std::unordered_set<std::string, StringHash, std::equal_to<>>;
+
+// The words of a statement as views into its text. Statements rarely have
+// more than a handful of words, so those are kept inline and splitting one
+// does not allocate. The views are only valid while the text is.
+class Tokens {
+public:
+	static constexpr size_t inline_capacity = 8;
+
+private:
+	std::array<std::string_view, inline_capacity> m_inline{};
+	std::vector<std::string_view> m_spilled{};	// every word, once they no longer fit inline
+	size_t m_size{};
+
+public:
+	Tokens() = default;
+	Tokens(std::initializer_list<std::string_view> words);
+
+	void push_back(std::string_view word);
+	size_t size() const;
+	bool empty() const;
+	std::string_view operator[](size_t index) const;
+	const std::string_view* begin() const;
+	const std::string_view* end() const;
+
+	// The words from the given one on, still viewing the same text
+	Tokens From(size_t from) const;
+	std::vector<std::string> ToStrings(size_t from = 0) const;
+};
+
+// Statements may run over several lines, so any of these separates words
+bool IsWhitespace(char c);
+
+// Split a statement on whitespace, as Parser::ParseArgs does
+Tokens Tokenize(std::string_view statement);
+// The keyword a statement starts with
+std::string_view FirstWord(std::string_view statement);
+
+}
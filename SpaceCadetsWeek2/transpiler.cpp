@@ -0,0 +1,477 @@
+#include "transpiler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+namespace bbones {
+
+namespace {
+	// Everything the generated code needs besides the program itself
+	constexpr std::string_view prelude{ R"(// Generated from a BareBones program by SpaceCadetsTranspiler.
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+	[[noreturn, maybe_unused]] void Fault(const char* message)
+	{
+		throw std::runtime_error{ message };
+	}
+
+	[[maybe_unused]] void Print(const char* name, int32_t value)
+	{
+		std::cout << name << " = " << value << '\n';
+	}
+
+	[[maybe_unused]] int32_t Add(int32_t lhs, int32_t rhs)
+	{
+		return static_cast<int32_t>(static_cast<uint32_t>(lhs) + static_cast<uint32_t>(rhs));
+	}
+
+	[[maybe_unused]] int32_t Sub(int32_t lhs, int32_t rhs)
+	{
+		return static_cast<int32_t>(static_cast<uint32_t>(lhs) - static_cast<uint32_t>(rhs));
+	}
+
+	[[maybe_unused]] int32_t Mul(int32_t lhs, int32_t rhs)
+	{
+		return static_cast<int32_t>(static_cast<uint32_t>(lhs) * static_cast<uint32_t>(rhs));
+	}
+
+)" };
+
+	constexpr std::string_view epilogue{ R"(}
+
+int main()
+{
+	try {
+		Run();
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
+)" };
+
+	std::optional<int32_t> DecodeLiteral(const std::string& literal)
+	{
+		// Same conversion the interpreter performs when it evaluates the statement
+		try {
+			return std::stoi(literal);
+		}
+		catch (const std::exception&) {
+			return std::nullopt;
+		}
+	}
+
+	std::string Literal(int32_t value)
+	{
+		// -2147483648 would be the negation of a literal too large for an int
+		if (value == std::numeric_limits<int32_t>::min())
+			return "INT32_MIN";
+		return std::to_string(value);
+	}
+
+	std::string Quote(const std::string& text)
+	{
+		static constexpr char digits[]{ "01234567" };
+		std::string result{ "\"" };
+		for (char c : text)
+		{
+			auto byte = static_cast<unsigned char>(c);
+			if (c == '"' || c == '\\')
+				result += { '\\', c };
+			else if (byte < 0x20)
+				result += { '\\', digits[byte >> 6], digits[(byte >> 3) & 7], digits[byte & 7] };
+			else
+				result += c;
+		}
+		return result + '"';
+	}
+
+	// C++ name for a variable ('v') or function ('f'). Names that would not
+	// make an identifier are spelled out in hex, which cannot clash as plain
+	// names always have an underscore after the prefix.
+	std::string Mangle(char prefix, const std::string& name)
+	{
+		static constexpr char digits[]{ "0123456789abcdef" };
+		auto plain = std::string{ prefix } + '_' + name;
+		bool is_identifier = !name.empty() && plain.find("__") == std::string::npos
+			&& std::all_of(name.begin(), name.end(), [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+		if (is_identifier)
+			return plain;
+
+		std::string result{ prefix, 'x' };
+		for (char c : name)
+			result += { digits[static_cast<unsigned char>(c) >> 4], digits[c & 0xF] };
+		return result;
+	}
+}
+
+Transpiler::Transpiler(const Parser& parser)
+	: m_parser{parser}
+{
+}
+
+void Transpiler::Line(const std::string& text)
+{
+	auto& frame = m_frames.back();
+	frame.body.append(frame.indent, '\t');
+	frame.body += text;
+	frame.body += '\n';
+}
+
+void Transpiler::EmitFault(const std::string& message)
+{
+	Line("Fault(" + Quote(message) + ");");
+}
+
+// Follows Compiler::Resolve: innermost block first, never past the frame
+bool Transpiler::Resolve(const std::string& name) const
+{
+	const auto& scopes = m_frames.back().scopes;
+	return std::any_of(scopes.begin(), scopes.end(), [&](const auto& scope) { return scope.contains(name); });
+}
+
+std::string Transpiler::Declare(const std::string& name)
+{
+	m_frames.back().scopes.back().insert(name);
+	return "int32_t " + Mangle('v', name);
+}
+
+std::optional<std::string> Transpiler::Use(const std::string& name)
+{
+	if (!Resolve(name))
+	{
+		EmitFault("Error: tried to access variable \"" + name + "\" when it does not exist!");
+		return std::nullopt;
+	}
+	return Mangle('v', name);
+}
+
+// The expression testing a condition. Errors are raised when it is evaluated,
+// so that an elif only fails if the branches before it were not taken.
+std::string Transpiler::TranspileCondition(const std::vector<std::string>& words, size_t at)
+{
+	static const std::unordered_map<std::string, std::string> comparisons{
+		{"is", "=="},
+		{"not", "!="},
+		{"<", "<"},
+		{"<=", "<="},
+		{">", ">"},
+		{">=", ">="}
+	};
+
+	auto fault = [](const std::string& message) { return "(Fault(" + Quote(message) + "), true)"; };
+	if (words.size() < at + 3)
+		return fault("Error: malformed condition in \"" + words[0] + "\" statement.");
+	if (!Resolve(words[at]))
+		return fault("Error: tried to access variable \"" + words[at] + "\" when it does not exist!");
+
+	auto cmp = comparisons.find(words[at + 1]);
+	if (cmp == comparisons.end())
+		return fault("Error: unknown comparison \"" + words[at + 1] + "\".");
+	// Anything that is not an integer is a variable to compare with
+	auto literal = DecodeLiteral(words[at + 2]);
+	if (literal.has_value())
+		return Mangle('v', words[at]) + ' ' + cmp->second + ' ' + Literal(literal.value());
+	if (!Resolve(words[at + 2]))
+		return fault("Error: tried to access variable \"" + words[at + 2] + "\" when it does not exist!");
+	return Mangle('v', words[at]) + ' ' + cmp->second + ' ' + Mangle('v', words[at + 2]);
+}
+
+void Transpiler::TranspileElse(const std::vector<std::string>& words, bool has_condition)
+{
+	// Outside of an if block the branch keywords are no-ops, as in the interpreter
+	if (m_blocks.empty() || m_blocks.back().kind != BlockKind::If)
+		return;
+
+	auto& block = m_blocks.back();
+	auto& frame = m_frames.back();
+	frame.scopes.back().clear();
+	frame.indent--;
+
+	// C++ allows nothing after an else, and BareBones never reaches what follows one
+	if (block.has_else)
+	{
+		Line("}");
+		Line("if (false) {");
+	}
+	else if (has_condition)
+	{
+		Line("} else if (" + TranspileCondition(words, 1) + ") {");
+	}
+	else
+	{
+		Line("} else {");
+		block.has_else = true;
+	}
+	frame.indent++;
+}
+
+void Transpiler::TranspileEnd()
+{
+	if (m_blocks.empty())
+	{
+		EmitFault(EndStatementException{}.what());
+		return;
+	}
+
+	auto block = m_blocks.back();
+	m_blocks.pop_back();
+
+	if (block.kind == BlockKind::Function)
+	{
+		FinishFunction();
+		return;
+	}
+
+	auto& frame = m_frames.back();
+	frame.scopes.pop_back();
+	frame.indent--;
+	Line("}");
+}
+
+void Transpiler::FinishFunction()
+{
+	const auto& frame = m_frames.back();
+	if (frame.is_defined)
+		m_definitions += '\t' + frame.signature + "\n\t{\n" + frame.body + "\t}\n\n";
+	m_frames.pop_back();
+}
+
+// function name ( a b ) do;
+void Transpiler::TranspileFunction(const std::vector<std::string>& words)
+{
+	std::vector<std::string> params{};
+	bool started = false;
+	bool finished = false;
+	for (size_t i = 2; i < words.size() && !finished; i++)
+	{
+		if (words[i] == "(")
+			started = true;
+		else if (words[i] == ")")
+			finished = true;
+		else if (started)
+			params.push_back(words[i]);
+	}
+
+	if (words.size() < 2 || !finished)
+		EmitFault(started ? "Error in function definition: expected \")\"." : "Error in function definition: expected \"(\".");
+
+	m_blocks.push_back({ BlockKind::Function });
+	m_frames.push_back({ { {} } });
+
+	// A repeated parameter still takes its argument, under no name
+	std::string param_list{};
+	std::optional<std::string> duplicate{};
+	for (const auto& param : params)
+	{
+		if (!param_list.empty())
+			param_list += ", ";
+		if (Resolve(param))
+		{
+			duplicate = param;
+			param_list += "int32_t";
+		}
+		else
+		{
+			param_list += Declare(param);
+		}
+	}
+	if (duplicate.has_value())
+		EmitFault("Tried to create variable \"" + duplicate.value() + "\" when that variable already exists!");
+
+	// As with Parser::AddMapping, the first definition of a name wins
+	if (words.size() >= 2 && !m_functions.contains(words[1]))
+	{
+		auto& frame = m_frames.back();
+		m_functions.insert({ words[1], params.size() });
+		frame.signature = "void " + Mangle('f', words[1]) + '(' + param_list + ')';
+		frame.is_defined = true;
+		m_declarations += '\t' + frame.signature + ";\n";
+	}
+}
+
+void Transpiler::TranspileCall(const std::string& name, const std::vector<std::string>& words)
+{
+	if (words.size() - 1 != m_functions.at(name))
+	{
+		EmitFault("Incorrect number of arguments passed to function call.");
+		return;
+	}
+
+	std::string args{};
+	for (size_t i = 1; i < words.size(); i++)
+	{
+		auto arg = Use(words[i]);
+		if (!arg.has_value())
+			return;
+		args += (i > 1) ? ", " + arg.value() : arg.value();
+	}
+	Line(Mangle('f', name) + '(' + args + ");");
+}
+
+void Transpiler::TranspileStatement(const std::string& statement)
+{
+	// keyword followed by arguments
+	auto words = m_parser.ParseArgs(0, statement).ToStrings();
+	if (words.empty() || !m_parser.GetStatementFor(words[0]).has_value())
+	{
+		if (words.empty() || !m_functions.contains(words[0]))
+			EmitFault("BareBones: instruction " + statement + " is not recognised!");
+		else
+			TranspileCall(words[0], words);
+		return;
+	}
+
+	static const std::unordered_map<std::string, std::string> wrapping{
+		{"add", "Add"},
+		{"sub", "Sub"},
+		{"mul", "Mul"},
+	};
+	static const std::unordered_map<std::string, std::string> dividing{
+		{"div", "/"},
+		{"mod", "%"},
+	};
+
+	const auto& keyword = words[0];
+	auto malformed = [&]() { EmitFault("Error: malformed \"" + keyword + "\" statement."); };
+
+	if (keyword == "init")
+	{
+		if (words.size() < 2)
+			return malformed();
+		if (Resolve(words[1]))
+			return EmitFault("Tried to create variable \"" + words[1] + "\" when that variable already exists!");
+		Line(Declare(words[1]) + " = 0;");
+	}
+	else if (keyword == "incr" || keyword == "decr" || keyword == "clear" || keyword == "print")
+	{
+		if (words.size() < 2)
+			return malformed();
+		auto var = Use(words[1]);
+		if (!var.has_value())
+			return;
+
+		if (keyword == "incr")
+			Line(var.value() + " = Add(" + var.value() + ", 1);");
+		else if (keyword == "decr")
+			Line(var.value() + " = Sub(" + var.value() + ", 1);");
+		else if (keyword == "clear")
+			Line(var.value() + " = 0;");
+		else
+			Line("Print(" + Quote(words[1]) + ", " + var.value() + ");");
+	}
+	else if (wrapping.contains(keyword) || dividing.contains(keyword))
+	{
+		// add X Y into Z
+		if (words.size() < 5)
+			return malformed();
+		auto lhs = Use(words[1]);
+		auto rhs = lhs.has_value() ? Use(words[2]) : std::nullopt;
+		auto into = rhs.has_value() ? Use(words[4]) : std::nullopt;
+		if (!into.has_value())
+			return;
+
+		// Division behaves as in the interpreter, including for a zero divisor
+		auto it = wrapping.find(keyword);
+		if (it != wrapping.end())
+			Line(into.value() + " = " + it->second + '(' + lhs.value() + ", " + rhs.value() + ");");
+		else
+			Line(into.value() + " = " + lhs.value() + ' ' + dividing.at(keyword) + ' ' + rhs.value() + ';');
+	}
+	else if (keyword == "copy")
+	{
+		// copy X to Y
+		if (words.size() < 4)
+			return malformed();
+		auto src = Use(words[1]);
+		auto dst = src.has_value() ? Use(words[3]) : std::nullopt;
+		if (dst.has_value())
+			Line(dst.value() + " = " + src.value() + ';');
+	}
+	else if (keyword == "set")
+	{
+		// set X 10 - assigns if X is visible, otherwise declares it in the current block
+		if (words.size() < 3)
+			return malformed();
+		auto literal = DecodeLiteral(words[2]);
+		if (!literal.has_value())
+			return EmitFault("Error: \"" + words[2] + "\" is not an integer.");
+		auto var = Resolve(words[1]) ? Mangle('v', words[1]) : Declare(words[1]);
+		Line(var + " = " + Literal(literal.value()) + ';');
+	}
+	else if (keyword == "while" || keyword == "if")
+	{
+		Line(keyword + " (" + TranspileCondition(words, 1) + ") {");
+		m_blocks.push_back({ (keyword == "while") ? BlockKind::While : BlockKind::If });
+		m_frames.back().scopes.push_back({});
+		m_frames.back().indent++;
+	}
+	else if (keyword == "elif")
+	{
+		TranspileElse(words, true);
+	}
+	else if (keyword == "else")
+	{
+		TranspileElse(words, false);
+	}
+	else if (keyword == "end")
+	{
+		TranspileEnd();
+	}
+	else if (keyword == "function")
+	{
+		TranspileFunction(words);
+	}
+	else
+	{
+		EmitFault("Error: \"" + keyword + "\" statements cannot be transpiled.");
+	}
+}
+
+std::string Transpiler::Transpile(IProgram* program)
+{
+	m_blocks.clear();
+	m_frames.clear();
+	m_functions.clear();
+	m_declarations.clear();
+	m_definitions.clear();
+
+	m_frames.push_back({ { {} }, "void Run()" });
+
+	for (size_t ordinal = 0; auto statement = program->Fetch(ordinal); ordinal++)
+		TranspileStatement(std::string{ statement.value() });
+
+	// Running off the end of the program inside a block is an error, wherever the block is left from
+	if (!m_blocks.empty())
+	{
+		const std::string message{ "Error: missing end statement." };
+		for (; !m_blocks.empty(); m_blocks.pop_back())
+		{
+			EmitFault(message);
+			if (m_blocks.back().kind == BlockKind::Function)
+			{
+				FinishFunction();
+				continue;
+			}
+			m_frames.back().scopes.pop_back();
+			m_frames.back().indent--;
+			Line("}");
+		}
+		EmitFault(message);
+	}
+
+	std::string result{ prelude };
+	if (!m_declarations.empty())
+		result += m_declarations + '\n';
+	result += m_definitions;
+	result += '\t' + m_frames.back().signature + "\n\t{\n" + m_frames.back().body + "\t}\n";
+	result += epilogue;
+	return result;
+}
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "common.hpp"
+#include "lang.hpp"
+
+namespace bbones {
+
+// Translates a whole program into a standalone C++ translation unit, to be
+// built by the host compiler. Statements are recognised by keyword as in
+// Compiler, and follow the same rules for scoping and for errors:
+//
+//	- variables become locals of the C++ block matching their BareBones block
+//	- while and if/elif/else become C++ control flow
+//	- functions become C++ functions taking their arguments by value
+//	- errors the interpreter would raise when reaching a statement throw at
+//	  that point of the generated program, which then exits with status 1
+//
+// Arithmetic wraps at 32 bits instead of relying on signed overflow.
+class Transpiler {
+private:
+	enum class BlockKind {
+		While,
+		If,
+		Function,
+	};
+
+	struct OpenBlock {
+		BlockKind kind{};
+		bool has_else{};					// later branches of the if can never be taken
+	};
+
+	// The top level or a function body, written out separately since C++
+	// functions cannot nest. Lookups never cross a frame.
+	struct FrameInfo {
+		std::vector<std::unordered_set<std::string>> scopes{};
+		std::string signature{};
+		std::string body{};
+		int indent{2};						// inside the generated anonymous namespace
+		bool is_defined{};					// false for redefinitions, which can never be called
+	};
+
+	Parser m_parser{};
+	std::vector<OpenBlock> m_blocks{};
+	std::vector<FrameInfo> m_frames{};
+	std::unordered_map<std::string, size_t> m_functions{};		// name to number of parameters
+	std::string m_declarations{};
+	std::string m_definitions{};
+
+	bool Resolve(const std::string& name) const;
+	std::string Declare(const std::string& name);
+	std::optional<std::string> Use(const std::string& name);
+
+	void Line(const std::string& text);
+	void EmitFault(const std::string& message);
+
+	std::string TranspileCondition(const std::vector<std::string>& words, size_t at);
+	void TranspileStatement(const std::string& statement);
+	void TranspileElse(const std::vector<std::string>& words, bool has_condition);
+	void TranspileEnd();
+	void TranspileFunction(const std::vector<std::string>& words);
+	void TranspileCall(const std::string& name, const std::vector<std::string>& words);
+	void FinishFunction();
+
+public:
+	Transpiler(const Parser& parser);
+
+	std::string Transpile(IProgram* program);
+};
+
+}
@@ -0,0 +1,301 @@
+#include "vm.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace bbones {
+
+namespace {
+	// Arithmetic wraps around, as in the optimizer's Fold and in native code
+	int32_t Add(int32_t lhs, int32_t rhs)
+	{
+		return static_cast<int32_t>(static_cast<uint32_t>(lhs) + static_cast<uint32_t>(rhs));
+	}
+
+	int32_t Sub(int32_t lhs, int32_t rhs)
+	{
+		return static_cast<int32_t>(static_cast<uint32_t>(lhs) - static_cast<uint32_t>(rhs));
+	}
+
+	int32_t Mul(int32_t lhs, int32_t rhs)
+	{
+		return static_cast<int32_t>(static_cast<uint32_t>(lhs) * static_cast<uint32_t>(rhs));
+	}
+
+	bool IsConditionTrue(const Instruction& insn, const int32_t* slots)
+	{
+		auto value = slots[insn.a];
+		auto comparand = insn.slot_b ? slots[insn.b] : insn.b;
+		switch (insn.cmp)
+		{
+		case Comparison::Is:	return value == comparand;
+		case Comparison::Not:	return value != comparand;
+		case Comparison::Lt:	return value < comparand;
+		case Comparison::Lte:	return value <= comparand;
+		case Comparison::Gt:	return value > comparand;
+		case Comparison::Gte:	return value >= comparand;
+		default:				return true;
+		}
+	}
+}
+
+VirtualMachine::VirtualMachine(Bytecode code)
+	: m_code{std::move(code)}
+{
+	m_stack.resize(m_code.frame_size);
+	m_frames.push_back({ 0, 0, static_cast<size_t>(m_code.frame_size) });
+
+	m_hotness.resize(m_code.code.size());
+	m_native.resize(m_code.code.size());
+	SetJitThreshold(default_jit_threshold);
+}
+
+void VirtualMachine::SetJitThreshold(std::optional<uint32_t> threshold)
+{
+	m_jit_threshold = JitCompiler::IsSupported() ? threshold : std::nullopt;
+}
+
+size_t VirtualMachine::GetNativeRegionCount() const
+{
+	return std::count_if(m_native.begin(), m_native.end(), [](const auto& region) { return region != nullptr; });
+}
+
+// Run the loop or function starting at `at` natively once it is hot. Returns
+// false if it is still to be interpreted.
+bool VirtualMachine::EnterNative(int32_t at, int32_t* slots, int32_t& ip)
+{
+	auto& region = m_native[at];
+	if (region == nullptr)
+	{
+		// Only attempted once, regions that fail to compile stay interpreted
+		if (++m_hotness[at] != m_jit_threshold.value())
+			return false;
+		region = CompileRegion(at);
+		if (region == nullptr)
+			return false;
+	}
+
+	ip = region->Run(slots, this);
+	return true;
+}
+
+// A while loop runs up to its end, a function body up to its return
+std::unique_ptr<NativeRegion> VirtualMachine::CompileRegion(int32_t at)
+{
+	const auto& code = m_code.code;
+	int32_t last{};
+	if (code[at].op == OpCode::While)
+	{
+		last = code[at].target - 1;
+		auto closed = last > at && last < static_cast<int32_t>(code.size()) && (code[last].op == OpCode::End || code[last].op == OpCode::EndWhile) && code[last].target == at;
+		if (!closed)
+			return nullptr;
+	}
+	else
+	{
+		if (at == 0 || code[at - 1].op != OpCode::Function)
+			return nullptr;
+		last = code[at - 1].target - 1;
+	}
+
+	return JitCompiler{ m_code, { &PrintFromNative, &RunLoopFromNative } }.Compile(at, last);
+}
+
+void VirtualMachine::PrintFromNative(void* vm, int32_t name, int32_t value)
+{
+	std::cout << static_cast<VirtualMachine*>(vm)->m_code.names[name] << " = " << value << '\n';
+}
+
+void VirtualMachine::RunLoopFromNative(void* vm, int32_t at, int32_t* slots)
+{
+	auto* self = static_cast<VirtualMachine*>(vm);
+	self->RunLoop(self->m_code.code[at], slots);
+}
+
+// Functions get a fresh frame above the caller's, arguments are passed by value
+int32_t* VirtualMachine::Call(const Instruction& insn, int32_t return_address)
+{
+	const auto& function = m_code.functions[insn.a];
+	const auto& caller = m_frames.back();
+
+	CallFrame frame{ return_address, caller.base + caller.size, static_cast<size_t>(function.frame_size) };
+	if (m_stack.size() < frame.base + frame.size)
+		m_stack.resize(frame.base + frame.size);
+
+	auto* caller_slots = m_stack.data() + caller.base;
+	auto* slots = m_stack.data() + frame.base;
+	for (int32_t i{}; i < insn.c; i++)
+		slots[function.params[i]] = caller_slots[m_code.operands[insn.b + i]];
+
+	m_frames.push_back(frame);
+	return slots;
+}
+
+int32_t* VirtualMachine::Return(int32_t& ip)
+{
+	ip = m_frames.back().return_address;
+	m_frames.pop_back();
+	return m_stack.data() + m_frames.back().base;
+}
+
+void VirtualMachine::RunLoop(const Instruction& insn, int32_t* slots)
+{
+	const auto* loop_slots = m_code.operands.data() + insn.b;
+	m_loop_values.resize(insn.c);
+	for (int32_t i{}; i < insn.c; i++)
+		m_loop_values[i] = slots[loop_slots[i]];
+
+	m_code.loops[insn.a].Apply(m_loop_values);
+	for (int32_t i{}; i < insn.c; i++)
+		slots[loop_slots[i]] = m_loop_values[i];
+}
+
+void VirtualMachine::Execute()
+{
+	Run<false>();
+}
+
+void VirtualMachine::Profile()
+{
+	Run<true>();
+}
+
+template <bool Profiling>
+void VirtualMachine::Run()
+{
+	const auto* code = m_code.code.data();
+	auto* slots = m_stack.data() + m_frames.back().base;
+	int32_t ip = 0;
+	[[maybe_unused]] uint32_t history = 0;
+
+	while (true)
+	{
+		const auto& insn = code[ip++];
+		if constexpr (Profiling)
+		{
+			history = ((history << 8) | (static_cast<uint32_t>(insn.op) + 1)) & 0xFFFFFF;
+			if (history > 0xFF)
+				m_sequence_counts[history & 0xFFFF] += 1;
+			if (history > 0xFFFF)
+				m_sequence_counts[history] += 1;
+		}
+
+		switch (insn.op)
+		{
+		case OpCode::Init:
+		case OpCode::Clear:
+			slots[insn.a] = 0;
+			break;
+		case OpCode::Incr:
+			slots[insn.a] = Add(slots[insn.a], 1);
+			break;
+		case OpCode::Decr:
+			slots[insn.a] = Sub(slots[insn.a], 1);
+			break;
+		case OpCode::Copy:
+			slots[insn.c] = slots[insn.a];
+			break;
+		case OpCode::Set:
+			slots[insn.c] = insn.b;
+			break;
+		case OpCode::Add:
+			slots[insn.c] = Add(slots[insn.a], slots[insn.b]);
+			break;
+		case OpCode::Sub:
+			slots[insn.c] = Sub(slots[insn.a], slots[insn.b]);
+			break;
+		case OpCode::Mul:
+			slots[insn.c] = Mul(slots[insn.a], slots[insn.b]);
+			break;
+		case OpCode::Div:
+			slots[insn.c] = slots[insn.a] / slots[insn.b];
+			break;
+		case OpCode::Mod:
+			slots[insn.c] = slots[insn.a] % slots[insn.b];
+			break;
+		case OpCode::Print:
+			std::cout << m_code.names[insn.b] << " = " << slots[insn.a] << '\n';
+			break;
+		case OpCode::While:
+			if (!Profiling && m_jit_threshold.has_value() && EnterNative(ip - 1, slots, ip))
+				break;
+			[[fallthrough]];
+		case OpCode::If:
+			if (!IsConditionTrue(insn, slots))
+				ip = insn.target;
+			break;
+		case OpCode::Else:
+		case OpCode::End:
+		case OpCode::Function:
+			ip = insn.target;
+			break;
+		case OpCode::Call:
+			slots = Call(insn, ip);
+			ip = m_code.functions[insn.a].entry;
+			if (!Profiling && m_jit_threshold.has_value())
+				EnterNative(ip, slots, ip);
+			break;
+		case OpCode::Return:
+			slots = Return(ip);
+			break;
+		case OpCode::Loop:
+			RunLoop(insn, slots);
+			break;
+		case OpCode::Fault:
+			throw std::runtime_error{ m_code.messages[insn.a] };
+		case OpCode::Halt:
+			return;
+		case OpCode::StepEndWhile:
+			slots[insn.a] = Add(slots[insn.a], insn.b);
+			[[fallthrough]];
+		case OpCode::EndWhile: {
+			if (!Profiling && m_jit_threshold.has_value() && EnterNative(insn.target, slots, ip))
+				break;
+			const auto& loop = code[insn.target];
+			ip = IsConditionTrue(loop, slots) ? insn.target + 1 : loop.target;
+			break;
+		}
+		case OpCode::CopyCopy:
+			slots[insn.c] = slots[insn.a];
+			slots[insn.target] = slots[insn.b];
+			ip += 1;
+			break;
+		case OpCode::AddRotate:
+			slots[insn.c] = Add(slots[insn.a], slots[insn.b]);
+			slots[insn.a] = slots[insn.b];
+			slots[insn.b] = slots[insn.c];
+			ip += 2;
+			break;
+		}
+	}
+}
+
+std::vector<VirtualMachine::SequenceCount> VirtualMachine::GetHotSequences(size_t count) const
+{
+	std::vector<SequenceCount> sequences{};
+	for (auto [key, executed] : m_sequence_counts)
+	{
+		SequenceCount sequence{ {}, executed };
+		for (int shift = 16; shift >= 0; shift -= 8)
+		{
+			auto op = (key >> shift) & 0xFF;
+			if (op != 0)
+				sequence.ops.push_back(static_cast<OpCode>(op - 1));
+		}
+		sequences.push_back(sequence);
+	}
+
+	std::sort(sequences.begin(), sequences.end(), [](const auto& lhs, const auto& rhs) { return lhs.count > rhs.count; });
+	if (sequences.size() > count)
+		sequences.resize(count);
+	return sequences;
+}
+
+std::optional<int32_t> VirtualMachine::GetGlobal(const std::string& name) const
+{
+	auto it = m_code.globals.find(name);
+	if (it == m_code.globals.end())
+		return std::nullopt;
+	return m_stack[it->second];
+}
+
+}
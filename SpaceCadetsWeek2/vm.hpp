@@ -0,0 +1,72 @@
+#pragma once
+#include "common.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+
+namespace bbones {
+
+// Executes compiled bytecode with a single dispatch loop. Produces the same
+// output as the BareBones tree-walker for the same program.
+//
+// Variables live in one contiguous stack of slots. Each call frame is a
+// window onto that stack starting at its base.
+//
+// Loops and functions that run often enough are compiled to machine code by
+// JitCompiler and run natively from then on.
+class VirtualMachine {
+public:
+	static constexpr uint32_t default_jit_threshold = 1000;
+
+	struct SequenceCount {
+		std::vector<OpCode> ops{};
+		uint64_t count{};
+	};
+
+private:
+	struct CallFrame {
+		int32_t return_address{};
+		size_t base{};
+		size_t size{};
+	};
+
+	Bytecode m_code{};
+	std::vector<int32_t> m_stack{};
+	std::vector<CallFrame> m_frames{};
+	std::vector<int32_t> m_loop_values{};
+	std::unordered_map<uint32_t, uint64_t> m_sequence_counts{};		// keyed by up to three opcodes, oldest in the highest byte
+
+	std::optional<uint32_t> m_jit_threshold{};
+	std::vector<uint32_t> m_hotness{};								// entries into each loop and function
+	std::vector<std::unique_ptr<NativeRegion>> m_native{};
+
+	int32_t* Call(const Instruction& insn, int32_t return_address);
+	int32_t* Return(int32_t& ip);
+	void RunLoop(const Instruction& insn, int32_t* slots);
+
+	bool EnterNative(int32_t at, int32_t* slots, int32_t& ip);
+	std::unique_ptr<NativeRegion> CompileRegion(int32_t at);
+	static void PrintFromNative(void* vm, int32_t name, int32_t value);
+	static void RunLoopFromNative(void* vm, int32_t at, int32_t* slots);
+
+	template <bool Profiling>
+	void Run();
+
+public:
+	VirtualMachine(Bytecode code);
+
+	void Execute();
+
+	// Loops and functions entered this many times are compiled. None to only interpret.
+	void SetJitThreshold(std::optional<uint32_t> threshold);
+	size_t GetNativeRegionCount() const;
+
+	// Execute while counting how often each pair and triple of opcodes runs back
+	// to back. Used to pick sequences for FuseSuperinstructions.
+	void Profile();
+	std::vector<SequenceCount> GetHotSequences(size_t count) const;
+
+	// Value of a top level variable once execution has finished
+	std::optional<int32_t> GetGlobal(const std::string& name) const;
+};
+
+}
@@ -0,0 +1,86 @@
+#include "../SpaceCadetsWeek2/runtime.hpp"
+#include "../SpaceCadetsWeek2/parallel.hpp"
+#include "../SpaceCadetsWeek2/scan.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+namespace {
+	// A machine generated looking program: short statements, one per line
+	std::string GenerateProgram(size_t megabytes)
+	{
+		static constexpr std::string_view statements[]{
+			"incr counter;\n", "decr x;\n", "add x y into z;\n", "while x not 0 do;\n",
+			"    copy total to result;\n", "end;\n", "set y 1024;\n", "clear z;\n",
+		};
+
+		std::string result{};
+		result.reserve(megabytes << 20);
+		for (size_t i = 0; result.size() < (megabytes << 20); i++)
+			result += statements[i % std::size(statements)];
+		return result;
+	}
+
+	// Best of several runs, in seconds
+	template <typename F>
+	double Time(F&& f, int runs = 5)
+	{
+		double best = 1e300;
+		for (int i = 0; i < runs; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			f();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+		}
+		return best;
+	}
+}
+
+// SpaceCadetsWeek2Bench [megabytes]
+// Times the search for statement separators with each scan kernel the CPU
+// supports, then the whole of BaseProgram's statement indexing on one thread
+// and on every hardware thread.
+int main(int argc, char** argv)
+{
+	size_t megabytes = (argc > 1) ? std::stoul(argv[1]) : 64;
+	auto text = GenerateProgram(megabytes);
+	auto size_mb = static_cast<double>(text.size()) / (1 << 20);
+
+	std::vector<size_t> offsets{};
+	offsets.reserve(text.size() / 4);
+	for (auto kernel : { bbones::ScanKernel::Scalar, bbones::ScanKernel::Sse2, bbones::ScanKernel::Avx2 })
+	{
+		if (!bbones::IsSupported(kernel))
+		{
+			std::cout << bbones::GetScanKernelName(kernel) << ": not supported\n";
+			continue;
+		}
+
+		auto seconds = Time([&]() {
+			offsets.clear();
+			bbones::FindAll(text, ';', offsets, kernel);
+		});
+		std::cout << bbones::GetScanKernelName(kernel) << ": " << size_mb / seconds << " MB/s, "
+			<< offsets.size() << " separators\n";
+	}
+
+	auto hardware_threads = bbones::GetParallelThreads();
+	for (size_t threads : { size_t{ 1 }, hardware_threads })
+	{
+		bbones::SetParallelThreads(threads);
+		size_t statements = 0;
+		auto seconds = Time([&]() {
+			bbones::BaseProgram program{ text };
+			statements = program.GetStatementCount();
+		});
+		std::cout << "index (" << bbones::GetScanKernelName(bbones::GetBestScanKernel()) << ", " << threads << " threads): "
+			<< size_mb / seconds << " MB/s, " << statements << " statements\n";
+
+		if (hardware_threads == 1)
+			break;
+	}
+
+	return 0;
+}
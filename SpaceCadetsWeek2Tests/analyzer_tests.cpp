@@ -0,0 +1,158 @@
+#include "pch.h"
+#include "test_programs.hpp"
+#include "../SpaceCadetsWeek2/analyzer.hpp"
+
+namespace barebones_tests {
+	using namespace bbones;
+
+	Analysis AnalyzeSource(const std::string& source)
+	{
+		BaseProgram program{ source };
+		return Analyzer{ CreateLanguageParser() }.Analyze(&program);
+	}
+
+	testing::AssertionResult HasDiagnostic(const Analysis& analysis, size_t statement, const std::string& text)
+	{
+		for (const auto& diagnostic : analysis.diagnostics)
+		{
+			if (diagnostic.statement == statement && diagnostic.message.find(text) != std::string::npos)
+				return testing::AssertionSuccess();
+		}
+
+		auto failure = testing::AssertionFailure() << "no diagnostic at statement " << statement << " containing \"" << text << "\", found:";
+		for (const auto& diagnostic : analysis.diagnostics)
+			failure << "\n  " << diagnostic.statement << ": " << diagnostic.message;
+		return failure;
+	}
+
+	TEST(AnalyzerTests, ExamplesAreClean) {
+		ASSERT_TRUE(AnalyzeSource(fib_program).diagnostics.empty());
+		ASSERT_TRUE(AnalyzeSource(pow_program).diagnostics.empty());
+	}
+
+	TEST(AnalyzerTests, UndefinedVariable) {
+		auto analysis = AnalyzeSource(
+			"init x;\n"
+			"while x not 0 do;\n"
+			"    init y;\n"
+			"end;\n"
+			"incr y;\n"
+			"print z;\n"
+		);
+		ASSERT_EQ(analysis.diagnostics.size(), 2);
+		ASSERT_TRUE(HasDiagnostic(analysis, 4, "\"y\""));
+		ASSERT_TRUE(HasDiagnostic(analysis, 5, "\"z\""));
+	}
+
+	TEST(AnalyzerTests, FunctionsSeeOnlyTheirParameters) {
+		auto analysis = AnalyzeSource(
+			"set x 1;\n"
+			"function f ( a ) do;\n"
+			"    add a x into a;\n"
+			"end;\n"
+			"f x;\n"
+		);
+		ASSERT_EQ(analysis.diagnostics.size(), 1);
+		ASSERT_TRUE(HasDiagnostic(analysis, 2, "\"x\""));
+	}
+
+	TEST(AnalyzerTests, InitOfExistingVariable) {
+		auto analysis = AnalyzeSource(
+			"init x;\n"
+			"if x is 0 do;\n"
+			"    init x;\n"
+			"end;\n"
+		);
+		ASSERT_EQ(analysis.diagnostics.size(), 1);
+		ASSERT_TRUE(HasDiagnostic(analysis, 2, "already exists"));
+	}
+
+	TEST(AnalyzerTests, UnbalancedBlocks) {
+		auto missing = AnalyzeSource(
+			"init x;\n"
+			"while x not 0 do;\n"
+			"    if x is 1 do;\n"
+			"    end;\n"
+		);
+		ASSERT_EQ(missing.diagnostics.size(), 1);
+		ASSERT_TRUE(HasDiagnostic(missing, 1, "missing end"));
+
+		auto unexpected = AnalyzeSource(
+			"init x;\n"
+			"end;\n"
+		);
+		ASSERT_EQ(unexpected.diagnostics.size(), 1);
+		ASSERT_TRUE(HasDiagnostic(unexpected, 1, "Unexpected end"));
+	}
+
+	TEST(AnalyzerTests, Calls) {
+		auto analysis = AnalyzeSource(
+			"set x 2;\n"
+			"later x;\n"
+			"function later ( a ) do;\n"
+			"    print a;\n"
+			"end;\n"
+			"later x x;\n"
+			"sooner x;\n"
+		);
+		ASSERT_EQ(analysis.diagnostics.size(), 2);
+		ASSERT_TRUE(HasDiagnostic(analysis, 5, "number of arguments"));
+		ASSERT_TRUE(HasDiagnostic(analysis, 6, "not recognised"));
+	}
+
+	TEST(AnalyzerTests, DivisionByZero) {
+		auto analysis = AnalyzeSource(
+			"set x 6;\n"
+			"set y 3;\n"
+			"init z;\n"
+			"init q;\n"
+			"sub y y into z;\n"
+			"div x y into q;\n"
+			"div x z into q;\n"
+			"mod x z into q;\n"
+		);
+		ASSERT_EQ(analysis.diagnostics.size(), 2);
+		ASSERT_TRUE(HasDiagnostic(analysis, 6, "division by zero"));
+		ASSERT_TRUE(HasDiagnostic(analysis, 7, "division by zero"));
+	}
+
+	TEST(AnalyzerTests, VariableAccesses) {
+		auto analysis = AnalyzeSource(
+			"init x;\n"
+			"set y 1;\n"
+			"set x 2;\n"
+			"while y not 0 do;\n"
+			"    set y 0;\n"
+			"    set z 1;\n"
+			"end;\n"
+			"set z 1;\n"
+		);
+		ASSERT_TRUE(analysis.diagnostics.empty());
+		std::vector<VariableAccess> expected{
+			VariableAccess::New,
+			VariableAccess::New,
+			VariableAccess::Existing,
+			VariableAccess::Existing,
+			VariableAccess::Existing,
+			VariableAccess::New,
+			VariableAccess::Unchecked,
+			VariableAccess::New,
+		};
+		ASSERT_EQ(analysis.accesses, expected);
+	}
+
+	TEST(AnalyzerTests, AccessesArePassedToTheInterpreter) {
+		BaseProgram program{ "init x;\nset x 2;\n" };
+		auto analysis = Analyzer{ CreateLanguageParser() }.Analyze(&program);
+
+		// Creating an interpreter does not analyze the program again
+		auto unchecked = BareBones::Create(CreateLanguageParser(), &program);
+		ASSERT_EQ(unchecked.GetVariableAccess(0), VariableAccess::Unchecked);
+
+		auto checked = BareBones::Create(CreateLanguageParser(), &program, analysis.accesses);
+		ASSERT_EQ(checked.GetVariableAccess(0), VariableAccess::New);
+		ASSERT_EQ(checked.GetVariableAccess(1), VariableAccess::Existing);
+		checked.Execute();
+		ASSERT_EQ(checked.GetExecutionState().GetScope()->GetVariable("x").value()->GetValue(), 2);
+	}
+}
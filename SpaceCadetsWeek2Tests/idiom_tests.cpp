@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "test_programs.hpp"
+#include "../SpaceCadetsWeek2/idioms.hpp"
+
+namespace barebones_tests {
+	using namespace bbones;
+
+	TEST(LoopIdiomTests, RecognisesClassicLoops) {
+		BaseProgram prog{
+			"while x not 0 do;decr x;end;"
+			"while x not 0 do;decr x;incr y;end;"
+			"while x not 0 do;decr x;while y not 0 do;decr y;incr z;incr t;end;while t not 0 do;decr t;incr y;end;end;"
+			"while x not 0 do;decr x;print x;end;"
+			"while x > 0 do;decr x;end;"
+			"while x not 0 do;incr y;end;"
+		};
+		BlockTable blocks{ &prog };
+
+		auto clear = SummariseLoop(&prog, blocks, 0);
+		ASSERT_TRUE(clear.has_value());
+		EXPECT_TRUE(clear.value().IsTranslation());
+		EXPECT_EQ(clear.value().GetVariables(), std::vector<std::string>{ "x" });
+
+		auto add = SummariseLoop(&prog, blocks, 3);
+		ASSERT_TRUE(add.has_value());
+		EXPECT_TRUE(add.value().IsTranslation());
+
+		auto mul = SummariseLoop(&prog, blocks, 7);
+		ASSERT_TRUE(mul.has_value());
+		EXPECT_FALSE(mul.value().IsTranslation());
+		EXPECT_EQ(mul.value().GetVariables(), (std::vector<std::string>{ "x", "y", "z", "t" }));
+
+		// Loops with side effects, other conditions or no way to terminate are left alone
+		EXPECT_FALSE(SummariseLoop(&prog, blocks, 19).has_value());
+		EXPECT_FALSE(SummariseLoop(&prog, blocks, 23).has_value());
+		EXPECT_FALSE(SummariseLoop(&prog, blocks, 26).has_value());
+	}
+
+	TEST(LoopIdiomTests, MultiplyMatchesStepping) {
+		BaseProgram prog{ "while x not 0 do;decr x;while y not 0 do;decr y;incr z;incr t;end;while t not 0 do;decr t;incr y;end;end;" };
+		BlockTable blocks{ &prog };
+		auto mul = SummariseLoop(&prog, blocks, 0).value();
+
+		// A non-zero temporary changes y between iterations, which the summary has to follow
+		for (int32_t t0 : { 0, 2 })
+		{
+			int32_t x = 6, y = 7, z = 3, t = t0;
+			std::vector<int32_t> values{ x, y, z, t };
+			while (x != 0)
+			{
+				x -= 1;
+				for (; y != 0; y--) { z += 1; t += 1; }
+				for (; t != 0; t--) y += 1;
+			}
+
+			mul.Apply(values);
+			EXPECT_EQ(values, (std::vector<int32_t>{ x, y, z, t }));
+		}
+	}
+
+	TEST(LoopIdiomTests, CountersWrapAround) {
+		// Stepping this would take 2^32 - 3 iterations of the inner statements
+		std::string source{
+			"set x -3;\n"
+			"set y 10;\n"
+			"while x not 0 do;\n"
+			"    decr x;\n"
+			"    incr y;\n"
+			"end;\n"
+			"print x;\n"
+			"print y;\n"
+		};
+		auto expected = RunInterpreter(source);
+		ASSERT_EQ(expected, "x = 0\ny = 7\n");
+		ASSERT_EQ(RunVirtualMachine(source), expected);
+	}
+
+	TEST(LoopIdiomTests, LoopRunsInOneStep) {
+		BaseProgram prog{ "set x 1000;set y 0;while x not 0 do;decr x;incr y;end;" };
+		auto machine = BareBones::Create(CreateLanguageParser(), &prog);
+
+		machine.Step();
+		machine.Step();
+		machine.Step();
+		ASSERT_EQ(machine.GetExecutionState().GetCursor().GetOrdinal(), 6);
+		ASSERT_EQ(machine.GetExecutionState().GetScope()->GetVariable("y").value()->GetValue(), 1000);
+	}
+
+	TEST(LoopIdiomTests, MissingVariableFaultsLikeTheLoop) {
+		std::string source{
+			"set x 3;\n"
+			"while x not 0 do;\n"
+			"    decr x;\n"
+			"    incr y;\n"
+			"end;\n"
+		};
+		EXPECT_THROW(RunInterpreter(source), std::runtime_error);
+		EXPECT_THROW(RunVirtualMachine(source), std::runtime_error);
+	}
+}
@@ -0,0 +1,129 @@
+#include "pch.h"
+#include "test_programs.hpp"
+
+namespace barebones_tests {
+	using namespace bbones;
+
+	TEST(JitTests, FibMatchesInterpreter) {
+		ASSERT_EQ(RunJit(fib_program), RunInterpreter(fib_program));
+	}
+
+	TEST(JitTests, PowMatchesInterpreter) {
+		ASSERT_EQ(RunJit(pow_program), RunInterpreter(pow_program));
+	}
+
+	TEST(JitTests, FactorialMatchesInterpreter) {
+		// Overflows well before the end, which has to wrap the same way
+		std::string source{
+			"function factorial ( n ) do;\n"
+			"    set out 1;\n"
+			"    while n > 1 do;\n"
+			"        mul out n into out;\n"
+			"        decr n;\n"
+			"    end;\n"
+			"    print out;\n"
+			"end;\n"
+			"set n 0;\n"
+			"while n < 20 do;\n"
+			"    incr n;\n"
+			"    factorial n;\n"
+			"end;\n"
+		};
+		ASSERT_EQ(RunJit(source), RunInterpreter(source));
+	}
+
+	TEST(JitTests, BranchesAndArithmeticMatchInterpreter) {
+		std::string source{
+			"set total 0;\n"
+			"set i 40;\n"
+			"set three 3;\n"
+			"set seven 7;\n"
+			"set r 0;\n"
+			"set q 0;\n"
+			"set last 0;\n"
+			"while i not 0 do;\n"
+			"    mod i three into r;\n"
+			"    if r is 0 do;\n"
+			"        add total i into total;\n"
+			"    elif r is 1 do;\n"
+			"        div i seven into q;\n"
+			"        sub total q into total;\n"
+			"    else do;\n"
+			"        set j 2;\n"
+			"        while j >= 1 do;\n"
+			"            incr total;\n"
+			"            decr j;\n"
+			"        end;\n"
+			"    end;\n"
+			"    copy total to last;\n"
+			"    decr i;\n"
+			"end;\n"
+			"print total;\n"
+			"print last;\n"
+		};
+		ASSERT_EQ(RunJit(source), RunInterpreter(source));
+	}
+
+	TEST(JitTests, VariableComparisonsMatchInterpreter) {
+		std::string source{
+			"set i 0;\n"
+			"set n 300;\n"
+			"set half 150;\n"
+			"set total 0;\n"
+			"while i < n do;\n"
+			"    if i >= half do;\n"
+			"        incr total;\n"
+			"    elif i not total do;\n"
+			"        add total i into total;\n"
+			"    end;\n"
+			"    incr i;\n"
+			"end;\n"
+			"print total;\n"
+		};
+		ASSERT_EQ(RunJit(source), RunInterpreter(source));
+	}
+
+	TEST(JitTests, RecursionLeavesNativeCode) {
+		std::string source{
+			"function countdown ( n ) do;\n"
+			"    print n;\n"
+			"    if n > 0 do;\n"
+			"        decr n;\n"
+			"        countdown n;\n"
+			"    end;\n"
+			"end;\n"
+			"set n 5;\n"
+			"countdown n;\n"
+		};
+		ASSERT_EQ(RunJit(source), RunInterpreter(source));
+	}
+
+	TEST(JitTests, FaultsInsideNativeLoops) {
+		std::string source{
+			"set i 3;\n"
+			"while i not 0 do;\n"
+			"    print i;\n"
+			"    decr i;\n"
+			"    if i is 1 do;\n"
+			"        print missing;\n"
+			"    end;\n"
+			"end;\n"
+		};
+		EXPECT_THROW(RunJit(source), std::runtime_error);
+	}
+
+	TEST(JitTests, HotRegionsAreCompiled) {
+		if (!JitCompiler::IsSupported())
+			GTEST_SKIP();
+
+		BaseProgram program{ pow_program };
+		VirtualMachine vm{ Compiler{ CreateLanguageParser() }.Compile(&program) };
+		vm.SetJitThreshold(1);
+
+		testing::internal::CaptureStdout();
+		vm.Execute();
+		ASSERT_EQ(testing::internal::GetCapturedStdout(), "out = 25\nout = 2187\n");
+		// The loop is part of the function's region, not one of its own
+		ASSERT_EQ(vm.GetNativeRegionCount(), 1);
+	}
+}
@@ -41,5 +41,58 @@ namespace barebones_tests {
 		ASSERT_EQ(bbones_alias.GetExecutionState().GetScope()->GetVariable("X").value()->GetValue(), 24);
 		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("X").value()->GetValue(), 24);
 	}
+
+	TEST(TestBareBones, AliasSharesProgramTest) {
+		BareBones bbones = BareBones::Create( Parser{}, nullptr );
+
+		// aliases view the same program, so functions defined through one are visible to all
+		BareBones bbones_alias = bbones.BuildAlias().Finish();
+		ASSERT_EQ(&bbones_alias.GetParser(), &bbones.GetParser());
+		ASSERT_EQ(&bbones_alias.GetBlockTable(), &bbones.GetBlockTable());
+	}
+
+	TEST(TestBareBones, CopyOwnsProgramTest) {
+		auto parser = Parser::Builder()
+			.AddMapping("function", new FunctionDefinitionStatement{})
+			.AddMapping("end", new EndStatement{})
+			.Finish();
+		BaseProgram prog{ "function f ( ) do;end;" };
+		BareBones bbones = BareBones::Create(parser, &prog);
+		BareBones bbones_copy = bbones.BuildCopy().Finish();
+		ASSERT_NE(&bbones_copy.GetParser(), &bbones.GetParser());
+
+		// a function defined by the copy is not seen by the original
+		bbones_copy.Execute();
+		ASSERT_TRUE(bbones_copy.GetParser().Parse("f").has_value());
+		ASSERT_FALSE(bbones.GetParser().Parse("f").has_value());
+		ASSERT_FALSE(bbones.IsFinished());
+
+		bbones_copy.SetMemoizing(false);
+		ASSERT_TRUE(bbones.IsMemoizing());
+	}
+
+	TEST(TestBareBones, TraceStepTest) {
+		auto parser = Parser::Builder()
+			.AddMapping("init", new InitStatement{})
+			.AddMapping("decr", new DecrementStatement{})
+			.AddMapping("set", new SetStatement{})
+			.AddMapping("while", new WhileStatement{})
+			.AddMapping("end", new EndStatement{})
+			.Finish();
+		BaseProgram prog{ "set X 1;while X not 0 do;init Y;decr X;end;" };
+		BareBones bbones = BareBones::Create(parser, &prog);
+
+		// Entering the loop opens its scope, reaching the end closes it and tests again
+		std::vector<std::string> names{};
+		std::vector<size_t> depths{};
+		while (auto step = bbones.TraceStep())
+		{
+			names.push_back(step->statement_name);
+			depths.push_back(step->stack_depth_after);
+		}
+		ASSERT_EQ(names, (std::vector<std::string>{ "set", "while", "init", "decr", "end", "while" }));
+		ASSERT_EQ(depths, (std::vector<size_t>{ 1, 2, 2, 2, 1, 1 }));
+		ASSERT_TRUE(bbones.IsFinished());
+		ASSERT_FALSE(bbones.Step());
+	}
 }
-	
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include "pch.h"
+#include "test_programs.hpp"
+
+namespace barebones_tests {
+	using namespace bbones;
+
+	Bytecode CompileOptimized(const std::string& source, const OptimizerOptions& options = {})
+	{
+		BaseProgram program{ source };
+		auto code = Compiler{ CreateLanguageParser() }.Compile(&program);
+		Optimize(code, options);
+		return code;
+	}
+
+	std::vector<OpCode> GetOpCodes(const Bytecode& code)
+	{
+		std::vector<OpCode> ops{};
+		for (const auto& insn : code.code)
+			ops.push_back(insn.op);
+		return ops;
+	}
+
+	TEST(OptimizerTests, ExamplesMatchInterpreter) {
+		ASSERT_EQ(RunVirtualMachine(fib_program, OptimizerOptions{}), RunInterpreter(fib_program));
+		ASSERT_EQ(RunVirtualMachine(pow_program, OptimizerOptions{}), RunInterpreter(pow_program));
+	}
+
+	TEST(OptimizerTests, ConstantsAndCopiesFold) {
+		std::string source{
+			"set a 6;\n"
+			"set b 7;\n"
+			"init c;\n"
+			"init d;\n"
+			"init e;\n"
+			"mul a b into c;\n"
+			"copy c to d;\n"
+			"copy d to e;\n"
+			"incr e;\n"
+			"print e;\n"
+		};
+		// Top level variables are still set, as they can be read once the program has run
+		auto code = CompileOptimized(source);
+		ASSERT_EQ(GetOpCodes(code), (std::vector<OpCode>{ OpCode::Set, OpCode::Set, OpCode::Set, OpCode::Set, OpCode::Set, OpCode::Print, OpCode::Halt }));
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), "e = 43\n");
+	}
+
+	TEST(OptimizerTests, CopiesAreForwarded) {
+		// n varies, so only the copy can be forwarded
+		std::string source{
+			"function show ( n ) do;\n"
+			"    init m;\n"
+			"    init twice;\n"
+			"    copy n to m;\n"
+			"    add m m into twice;\n"
+			"    print twice;\n"
+			"end;\n"
+			"set x 4;\n"
+			"show x;\n"
+		};
+		auto code = CompileOptimized(source);
+		auto ops = GetOpCodes(code);
+		EXPECT_EQ(std::count(ops.begin(), ops.end(), OpCode::Copy), 0);
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), RunInterpreter(source));
+	}
+
+	TEST(OptimizerTests, BranchesOnConstantsAreRemoved) {
+		std::string source{
+			"set x 1;\n"
+			"if x is 0 do;\n"
+			"    print x;\n"
+			"elif x is 1 do;\n"
+			"    incr x;\n"
+			"else do;\n"
+			"    clear x;\n"
+			"end;\n"
+			"while x > 5 do;\n"
+			"    decr x;\n"
+			"end;\n"
+			"print x;\n"
+		};
+		auto code = CompileOptimized(source);
+		ASSERT_EQ(GetOpCodes(code), (std::vector<OpCode>{ OpCode::Set, OpCode::Print, OpCode::Halt }));
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), RunInterpreter(source));
+	}
+
+	TEST(OptimizerTests, LoopsAndGlobalsAreKept) {
+		std::string source{
+			"set i 10;\n"
+			"set total 0;\n"
+			"set unused 3;\n"
+			"set unused 4;\n"
+			"while i not 0 do;\n"
+			"    add total i into total;\n"
+			"    decr i;\n"
+			"end;\n"
+		};
+		VirtualMachine vm{ CompileOptimized(source) };
+		vm.Execute();
+		ASSERT_EQ(vm.GetGlobal("total"), 55);
+		ASSERT_EQ(vm.GetGlobal("unused"), 4);
+	}
+
+	TEST(OptimizerTests, DeadStoresAreRemoved) {
+		std::string source{
+			"function f ( n ) do;\n"
+			"    set scratch 5;\n"
+			"    copy n to scratch;\n"
+			"    clear scratch;\n"
+			"    print n;\n"
+			"end;\n"
+			"set x 2;\n"
+			"f x;\n"
+		};
+		auto code = CompileOptimized(source, { false, false, false, false, false, false, false, false });
+		auto reports = Optimize(code);
+		ASSERT_EQ(reports.size(), 8);
+		EXPECT_EQ(reports[3].pass, "dead-store-elimination");
+		EXPECT_EQ(reports[3].removed, 3);
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), "n = 2\n");
+	}
+
+	TEST(OptimizerTests, PassesCanBeTurnedOff) {
+		std::string source{ "set a 6;set b 7;init c;mul a b into c;print c;" };
+		auto unoptimized = CompileOptimized(source, { false, false, false, false, false, false, false, false });
+		ASSERT_EQ(unoptimized.code.size(), 6);
+
+		auto folded = CompileOptimized(source, { true, true, true, false, false, false, false, false });
+		EXPECT_EQ(GetOpCodes(folded), (std::vector<OpCode>{ OpCode::Set, OpCode::Set, OpCode::Init, OpCode::Set, OpCode::Print, OpCode::Halt }));
+
+		auto reports = Optimize(unoptimized, { false, false, true, false, false, false, false, false });
+		ASSERT_EQ(reports.size(), 1);
+		EXPECT_EQ(reports[0].pass, "constant-folding");
+		EXPECT_EQ(reports[0].rewritten, 1);
+	}
+
+	TEST(OptimizerTests, TrappingDivisionIsKept) {
+		std::string source{ "set a 6;set b 0;init c;div a b into c;set c 1;print c;" };
+		auto ops = GetOpCodes(CompileOptimized(source));
+		EXPECT_EQ(std::count(ops.begin(), ops.end(), OpCode::Div), 1);
+	}
+
+	TEST(OptimizerTests, FaultsAreKept) {
+		std::string source{
+			"set x 3;\n"
+			"while x not 0 do;\n"
+			"    print x;\n"
+			"    decr x;\n"
+			"    if x is 1 do;\n"
+			"        print missing;\n"
+			"    end;\n"
+			"end;\n"
+		};
+		EXPECT_THROW(RunVirtualMachine(source, OptimizerOptions{}), std::runtime_error);
+	}
+
+	// Instructions between the while at `opener` and its end
+	std::vector<OpCode> GetLoopBody(const Bytecode& code, size_t opener)
+	{
+		std::vector<OpCode> ops{};
+		for (auto at = opener + 1; at + 1 < static_cast<size_t>(code.code[opener].target); at++)
+			ops.push_back(code.code[at].op);
+		return ops;
+	}
+
+	size_t FindOpCode(const Bytecode& code, OpCode op)
+	{
+		auto ops = GetOpCodes(code);
+		return std::find(ops.begin(), ops.end(), op) - ops.begin();
+	}
+
+	TEST(OptimizerTests, InvariantsAreHoisted) {
+		std::string source{
+			"function scaled ( n k ) do;\n"
+			"    while n not 0 do;\n"
+			"        init scale;\n"
+			"        mul k k into scale;\n"
+			"        print scale;\n"
+			"        decr n;\n"
+			"    end;\n"
+			"end;\n"
+			"set a 3;\n"
+			"set b 4;\n"
+			"scaled a b;\n"
+		};
+		auto code = CompileOptimized(source);
+		auto body = GetLoopBody(code, FindOpCode(code, OpCode::While));
+		EXPECT_EQ(body, (std::vector<OpCode>{ OpCode::Print, OpCode::Decr }));
+		EXPECT_LT(FindOpCode(code, OpCode::Mul), FindOpCode(code, OpCode::While));
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), RunInterpreter(source));
+	}
+
+	TEST(OptimizerTests, InductionProductsBecomeSums) {
+		std::string source{
+			"function down ( n k ) do;\n"
+			"    while n not 0 do;\n"
+			"        init t;\n"
+			"        mul n k into t;\n"
+			"        print t;\n"
+			"        decr n;\n"
+			"    end;\n"
+			"end;\n"
+			"function up ( s k ) do;\n"
+			"    init i;\n"
+			"    while i < 20 do;\n"
+			"        add i s into i;\n"
+			"        init t;\n"
+			"        mul k i into t;\n"
+			"        print t;\n"
+			"    end;\n"
+			"end;\n"
+			"set a 4;\n"
+			"set b 3;\n"
+			"down a b;\n"
+			"up b a;\n"
+		};
+		auto code = CompileOptimized(source);
+		for (size_t at{}; at < code.code.size(); at++)
+		{
+			if (code.code[at].op != OpCode::While)
+				continue;
+			auto body = GetLoopBody(code, at);
+			EXPECT_EQ(std::count(body.begin(), body.end(), OpCode::Mul), 0);
+		}
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), RunInterpreter(source));
+	}
+
+	TEST(OptimizerTests, ShortLoopsAreUnrolled) {
+		std::string source{
+			"set i 0;\n"
+			"set total 0;\n"
+			"while i < 4 do;\n"
+			"    add total i into total;\n"
+			"    print total;\n"
+			"    incr i;\n"
+			"end;\n"
+		};
+		auto has_loop = [](const Bytecode& code) { return FindOpCode(code, OpCode::While) < code.code.size(); };
+		EXPECT_FALSE(has_loop(CompileOptimized(source)));
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), RunInterpreter(source));
+
+		// Too many iterations to copy the body for each
+		std::string long_loop{ "set i 0;while i < 100 do;incr i;end;" };
+		EXPECT_TRUE(has_loop(CompileOptimized(long_loop)));
+
+		OptimizerOptions options{};
+		options.unroll_loops = false;
+		EXPECT_TRUE(has_loop(CompileOptimized(source, options)));
+	}
+
+	TEST(OptimizerTests, ConstantComparandsBecomeLiterals) {
+		// The limit never changes, so the loop compares with 100 itself
+		std::string source{
+			"set i 0;\n"
+			"set limit 100;\n"
+			"while i < limit do;\n"
+			"    incr i;\n"
+			"end;\n"
+			"print i;\n"
+		};
+		auto code = CompileOptimized(source);
+		const auto& test = code.code[FindOpCode(code, OpCode::While)];
+		EXPECT_FALSE(test.slot_b);
+		EXPECT_EQ(test.b, 100);
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), RunInterpreter(source));
+
+		// Otherwise the variable is still read on every test
+		source.replace(source.find("while"), 0, "incr limit;\n");
+		source.replace(source.find("    incr i"), 0, "    decr limit;\n");
+		code = CompileOptimized(source);
+		EXPECT_TRUE(code.code[FindOpCode(code, OpCode::While)].slot_b);
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), RunInterpreter(source));
+	}
+
+	TEST(OptimizerTests, SmallFunctionsAreInlined) {
+		// Arguments are still passed by value, so x is unchanged by the calls
+		std::string source{
+			"function bump ( n ) do;\n"
+			"    incr n;\n"
+			"    print n;\n"
+			"end;\n"
+			"function twice ( n ) do;\n"
+			"    bump n;\n"
+			"    bump n;\n"
+			"end;\n"
+			"set x 1;\n"
+			"set i 20;\n"
+			"while i not 0 do;\n"
+			"    twice x;\n"
+			"    decr i;\n"
+			"end;\n"
+			"print x;\n"
+		};
+		auto ops = GetOpCodes(CompileOptimized(source));
+		EXPECT_EQ(std::count(ops.begin(), ops.end(), OpCode::Call), 0);
+		ASSERT_EQ(RunVirtualMachine(source, OptimizerOptions{}), RunInterpreter(source));
+
+		OptimizerOptions options{};
+		options.inline_budget = 1;
+		ops = GetOpCodes(CompileOptimized(source, options));
+		EXPECT_EQ(std::count(ops.begin(), ops.end(), OpCode::Call), 3);
+	}
+}
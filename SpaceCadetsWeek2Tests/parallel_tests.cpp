@@ -0,0 +1,78 @@
+#include "pch.h"
+#include "test_programs.hpp"
+#include "../SpaceCadetsWeek2/parallel.hpp"
+
+namespace barebones_tests {
+	using namespace bbones;
+
+	// Splits work as if there were more threads than this machine may have
+	struct ParallelThreadsGuard {
+		ParallelThreadsGuard(size_t threads) { SetParallelThreads(threads); }
+		~ParallelThreadsGuard() { SetParallelThreads(0); }
+	};
+
+	std::string GenerateStatements(size_t count)
+	{
+		std::string result{ "set x 0;\n" };
+		for (size_t i = 0; i < count; i++)
+		{
+			switch (i % 5)
+			{
+			case 0: result += "incr x;\n"; break;
+			case 1: result += "  decr x ;\n\n"; break;
+			case 2: result += "while x not 0 do;\r\n\tdecr x;\nend;"; break;
+			case 3: result += "if x is 0 do; incr x; else; clear x; end;\n"; break;
+			case 4: result += "print x;\n"; break;
+			}
+		}
+		return result + "print x";
+	}
+
+	TEST(ParallelTests, ParallelForCoversEveryItem) {
+		ParallelThreadsGuard threads{ 4 };
+		ASSERT_EQ(GetParallelChunks(1000, 10), 4);
+		ASSERT_EQ(GetParallelChunks(1000, 400), 2);
+		ASSERT_EQ(GetParallelChunks(0, 400), 1);
+
+		std::vector<int> seen(1000);
+		std::vector<size_t> begins(4);
+		ParallelFor(4, seen.size(), [&](size_t chunk, size_t begin, size_t end) {
+			begins[chunk] = begin;
+			for (size_t i = begin; i < end; i++)
+				seen[i] += 1;
+		});
+		ASSERT_EQ(seen, std::vector<int>(1000, 1));
+		ASSERT_EQ(begins, (std::vector<size_t>{ 0, 250, 500, 750 }));
+
+		ASSERT_THROW(ParallelFor(4, 8, [](size_t chunk, size_t, size_t) {
+			if (chunk == 2)
+				throw std::runtime_error("chunk failed");
+		}), std::runtime_error);
+	}
+
+	TEST(ParallelTests, IndexingMatchesSequential) {
+		// Empty statements are still statements
+		auto source = GenerateStatements(100000) + ";;\n" + GenerateStatements(100000);
+		BaseProgram sequential{ source };
+		ParallelThreadsGuard threads{ 4 };
+		BaseProgram parallel{ source };
+
+		ASSERT_EQ(parallel.GetStatementCount(), sequential.GetStatementCount());
+		for (size_t i = 0; i < sequential.GetStatementCount(); i++)
+		{
+			ASSERT_EQ(parallel.Fetch(i).value(), sequential.Fetch(i).value()) << i;
+			ASSERT_EQ(parallel.GetLine(i), sequential.GetLine(i)) << i;
+		}
+		ASSERT_EQ(parallel.Fetch(parallel.GetStatementCount() - 1).value(), "print x");
+	}
+
+	TEST(ParallelTests, DecodingMatchesSequential) {
+		// Functions are only registered as their definitions run, so the call
+		// is left to be decoded when it is reached
+		auto source = "set y 3;\nfunction f ( a ) do;\n    print a;\nend;\nf y;\n" + GenerateStatements(20000);
+		auto expected = RunInterpreter(source);
+
+		ParallelThreadsGuard threads{ 4 };
+		ASSERT_EQ(RunInterpreter(source), expected);
+	}
+}
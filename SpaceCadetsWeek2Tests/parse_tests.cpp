@@ -11,7 +11,7 @@ namespace barebones_tests {
 		auto result = parser.ParseArgs(0, fake_args);
 		auto expected = std::vector<std::string>{ "one", "two", "three", "four", "five", "six" };
 
-		ASSERT_EQ(expected, result);
+		ASSERT_EQ(expected, result.ToStrings());
 	}
 
 	TEST(TestParsing, TestGetArgs2) {
@@ -21,7 +21,7 @@ namespace barebones_tests {
 		auto result = parser.ParseArgs(0, fake_args);
 		auto expected = std::vector<std::string>{ "one" };
 
-		ASSERT_EQ(expected, result);
+		ASSERT_EQ(expected, result.ToStrings());
 	}
 
 	TEST(TestParsing, TestGetArgs3) {
@@ -31,7 +31,7 @@ namespace barebones_tests {
 		auto result = parser.ParseArgs(0, fake_args);
 		auto expected = std::vector<std::string>{ };
 
-		ASSERT_EQ(expected, result);
+		ASSERT_EQ(expected, result.ToStrings());
 	}
 
 	TEST(TestParsing, TestParse) {
@@ -44,7 +44,7 @@ namespace barebones_tests {
 
 		ASSERT_TRUE(result.has_value());
 		ASSERT_EQ(result.value().statement, statement);
-		ASSERT_EQ(result.value().args, expected_args);
+		ASSERT_EQ(result.value().args.ToStrings(), expected_args);
 	}
 
 	TEST(TestParsing, TestParse2) {
@@ -57,7 +57,80 @@ namespace barebones_tests {
 
 		ASSERT_TRUE(result.has_value());
 		ASSERT_EQ(result.value().statement, statement);
-		ASSERT_EQ(result.value().args, expected_args);
+		ASSERT_EQ(result.value().args.ToStrings(), expected_args);
+	}
+
+	TEST(TestParsing, TestTokenize) {
+		std::string statement{ " while  X not 0 do " };
+
+		auto result = Tokenize(statement);
+		auto expected = std::vector<std::string>{ "while", "X", "not", "0", "do" };
+
+		ASSERT_EQ(result.size(), expected.size());
+		ASSERT_EQ(result.ToStrings(), expected);
+		ASSERT_EQ(result[1].data(), statement.data() + 8);
+	}
+
+	TEST(TestParsing, TestTokenizeLineBreaks) {
+		std::string statement{ "add a b\r\n\tinto\nc" };
+
+		auto result = Tokenize(statement);
+		auto expected = std::vector<std::string>{ "add", "a", "b", "into", "c" };
+
+		ASSERT_EQ(result.ToStrings(), expected);
+		ASSERT_EQ(FirstWord("end\n"), "end");
+	}
+
+	TEST(TestParsing, TestTokenizeSpills) {
+		std::string statement{ "f a b c d e f g h i j" };
+
+		auto result = Tokenize(statement);
+		auto expected = std::vector<std::string>{ "f", "a", "b", "c", "d", "e", "f", "g", "h", "i", "j" };
+
+		ASSERT_GT(result.size(), Tokens::inline_capacity);
+		ASSERT_EQ(result.ToStrings(), expected);
+		ASSERT_EQ(std::vector<std::string>(result.begin(), result.end()), expected);
+		ASSERT_EQ(result.ToStrings(1).front(), "a");
+	}
+
+	TEST(TestParsing, TestParseUnknown) {
+		Parser parser{};
+		parser.AddMapping("clear", new ClearStatement{});
+
+		std::string_view statement{ "clearer X" };
+		ASSERT_FALSE(parser.Parse(statement).has_value());
+		ASSERT_FALSE(parser.Parse("").has_value());
+		ASSERT_EQ(parser.Parse(statement.substr(0, 5)).value().statement_name, "clear");
+	}
+
+	TEST(TestParsing, TestFindKeyword) {
+		for (size_t i = 0; i < keyword_count; i++)
+		{
+			auto keyword = FindKeyword(keyword_names[i]);
+			ASSERT_TRUE(keyword.has_value());
+			ASSERT_EQ(GetKeywordName(keyword.value()), keyword_names[i]);
+		}
+
+		static_assert(FindKeyword("while") == Keyword::While);
+		for (auto word : { "", "x", "in", "inct", "initialise", "While", "functions", "fib" })
+			ASSERT_FALSE(FindKeyword(word).has_value()) << word;
+	}
+
+	TEST(TestParsing, TestKeywordsAndFunctions) {
+		Parser parser{};
+		IStatement* first = new ClearStatement{};
+		IStatement* second = new ClearStatement{};
+		IStatement* function = new NoopStatement{};
+
+		parser.AddMapping("clear", first);
+		parser.AddMapping("clear", second);
+		parser.AddMapping("fib", function);
+
+		ASSERT_EQ(parser.GetStatementFor("clear").value(), first);
+		ASSERT_EQ(parser.GetStatementFor(Keyword::Clear).value(), first);
+		ASSERT_EQ(parser.GetStatementFor("fib").value(), function);
+		ASSERT_FALSE(parser.GetStatementFor("incr").has_value());
+		ASSERT_FALSE(parser.m_mappings.contains("clear"));
 	}
 
 };
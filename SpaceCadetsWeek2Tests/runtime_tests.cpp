@@ -1,5 +1,8 @@
 #include "pch.h"
 #include "../SpaceCadetsWeek2/runtime.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 
 namespace barebones_tests {
 	using namespace bbones;
@@ -80,6 +83,75 @@ namespace barebones_tests {
 		ASSERT_EQ(state.GetScope()->GetVariable("TestVar2").has_value(), false);
 	}
 
+	TEST(TestExecutionState, TestExecutionStateScopeReuse) {
+		ExecutionState state{};
+		auto* global_var = state.GetScope()->CreateVariable("Global");
+		*global_var = 7;
+
+		// Open enough scopes to spill over several chunks of the frame stack
+		for (int i{}; i < 200; i++)
+			*state.PushScope()->CreateVariable("Local" + std::to_string(i)) = i;
+
+		ASSERT_EQ(state.GetScope()->GetDepth(), 201);
+		ASSERT_EQ(state.GetScope()->GetVariable("Local10").value()->GetValue(), 10);
+		ASSERT_EQ(global_var->GetValue(), 7);
+
+		// Reopened scopes start out empty
+		for (int i{}; i < 200; i++)
+			state.PopScope();
+		auto* scope = state.PushScope();
+		ASSERT_EQ(scope->GetVariable("Local0").has_value(), false);
+		ASSERT_EQ(scope->GetVariable("Global").value(), global_var);
+	}
+
+	TEST(TestExecutionState, TestExecutionStateWideScopes) {
+		ExecutionState state{};
+
+		// Wide enough for every frame to be searched through its index
+		for (int i{}; i < 2000; i++)
+			*state.GetScope()->CreateVariable("Global" + std::to_string(i)) = i;
+		ASSERT_EQ(state.GetScope()->GetVariable("Global1234").value()->GetValue(), 1234);
+
+		for (int i{}; i < 100; i++)
+			*state.PushScope()->CreateVariable("Local" + std::to_string(i)) = i;
+		auto* inner = state.PushScope();
+		for (int i{}; i < 100; i++)
+			*inner->CreateVariable("Inner" + std::to_string(i)) = -i;
+		ASSERT_EQ(inner->GetVariable("Inner99").value()->GetValue(), -99);
+		ASSERT_EQ(inner->GetVariable("Local42").value()->GetValue(), 42);
+		ASSERT_EQ(inner->GetVariable("Global1999").value()->GetValue(), 1999);
+		ASSERT_THROW(inner->CreateVariable("Global7"), std::runtime_error);
+
+		// Variables created once a frame is indexed are found too
+		*state.GetScope()->CreateVariable("Late") = 5;
+		ASSERT_EQ(state.GetScope()->GetVariable("Late").value()->GetValue(), 5);
+
+		// A frame reopened in the same place does not see the old index
+		state.PopScope();
+		auto* reopened = state.PushScope();
+		ASSERT_FALSE(reopened->GetVariable("Inner3").has_value());
+		ASSERT_FALSE(reopened->GetVariable("Late").has_value());
+		for (int i{}; i < 20; i++)
+			*reopened->CreateVariable("Inner" + std::to_string(i)) = i;
+		ASSERT_EQ(reopened->GetVariable("Inner3").value()->GetValue(), 3);
+		ASSERT_FALSE(reopened->GetVariable("Inner50").has_value());
+	}
+
+	TEST(TestExecutionState, TestExecutionStateFrameSerials) {
+		ExecutionState state{};
+		auto global = state.GetScope()->GetSerial();
+		auto first = state.PushScope()->GetSerial();
+		state.PopScope();
+		auto reopened = state.PushScope()->GetSerial();
+		ASSERT_NE(first, global);
+		ASSERT_NE(reopened, first);
+
+		// A copy holds other variables, so none of its frames share a serial
+		auto copy = state.DeepCopy();
+		ASSERT_NE(copy.GetGlobalScope()->GetSerial(), global);
+		ASSERT_NE(copy.GetScope()->GetSerial(), reopened);
+	}
+
 	TEST(TestProgram, TestProgramFetch) {
 		std::string program_txt = "incr X;clear Y;decr X;";
 		BaseProgram prog = BaseProgram{ program_txt };
@@ -103,4 +175,103 @@ namespace barebones_tests {
 		EXPECT_EQ(prog.Fetch(1).has_value(), true);
 		EXPECT_EQ(prog.Fetch(1).value(), "clear Y");
 	}
-}
\ No newline at end of file
+
+	TEST(TestProgram, TestProgramFetchIndexed) {
+		std::string program_txt = "  incr X ;\n\tclear Y;\r\ndecr X;\n  ";
+		BaseProgram prog = BaseProgram{ program_txt };
+
+		// Trailing whitespace after the last semicolon is not a statement
+		EXPECT_EQ(prog.GetStatementCount(), 3);
+		EXPECT_EQ(prog.Fetch(0).value(), "incr X");
+		EXPECT_EQ(prog.Fetch(1).value(), "clear Y");
+		EXPECT_EQ(prog.Fetch(2).value(), "decr X");
+		EXPECT_FALSE(prog.Fetch(3).has_value());
+	}
+
+	TEST(TestProgram, TestProgramFetchLarge) {
+		// Enough statements that the separator scan covers several blocks
+		std::string program_txt{};
+		for (int i = 0; i < 20000; i++)
+			program_txt += "incr X" + std::to_string(i) + ";\n";
+		BaseProgram prog{ program_txt };
+
+		ASSERT_EQ(prog.GetStatementCount(), 20000);
+		EXPECT_EQ(prog.Fetch(0).value(), "incr X0");
+		EXPECT_EQ(prog.Fetch(12345).value(), "incr X12345");
+		EXPECT_EQ(prog.Fetch(19999).value(), "incr X19999");
+		EXPECT_EQ(prog.GetLine(19999), 20000);
+	}
+
+	TEST(TestProgram, TestProgramLines) {
+		BaseProgram prog{ "incr X;\n\nclear Y; decr X;\nwhile X\nnot 0 do;" };
+
+		EXPECT_EQ(prog.GetLine(0), 1);
+		EXPECT_EQ(prog.GetLine(1), 3);
+		EXPECT_EQ(prog.GetLine(2), 3);
+		EXPECT_EQ(prog.GetLine(3), 4);
+		EXPECT_EQ(prog.GetLine(4), 0);
+	}
+
+	TEST(TestProgram, TestProgramFromFile) {
+		auto path = (std::filesystem::temp_directory_path() / "barebones_mapped_test.bbns").string();
+		{
+			std::ofstream file{ path, std::ios::binary };
+			file << "incr X;\r\nclear Y;\ndecr X";
+		}
+
+		auto prog = CreateProgramFromFile(path);
+		ASSERT_TRUE(prog.has_value());
+		EXPECT_EQ(prog.value()->GetStatementCount(), 3);
+		EXPECT_EQ(prog.value()->Fetch(1).value(), "clear Y");
+		EXPECT_EQ(prog.value()->Fetch(2).value(), "decr X");
+		EXPECT_EQ(prog.value()->GetLine(2), 3);
+		delete prog.value();
+
+		std::filesystem::remove(path);
+		EXPECT_FALSE(CreateProgramFromFile(path).has_value());
+	}
+
+	TEST(TestProgram, TestProgramFromStream) {
+		std::istringstream input{ "incr X;\nclear Y;\n" };
+		std::unique_ptr<BaseProgram> prog{ CreateProgramFromStream(input) };
+
+		EXPECT_EQ(prog->GetStatementCount(), 2);
+		EXPECT_EQ(prog->Fetch(0).value(), "incr X");
+		EXPECT_EQ(prog->GetLine(1), 2);
+	}
+
+	TEST(TestBlockTable, TestBlockTableMatching) {
+		// 0: while, 1: if, 2: incr, 3: elif, 4: decr, 5: else, 6: end (if), 7: decr, 8: end (while)
+		BaseProgram prog{ "while X not 0 do;if X is 1 do;incr Y;elif X is 2 do;decr Y;else do;end;decr X;end;" };
+		BlockTable blocks{ &prog };
+
+		EXPECT_EQ(blocks.GetEnd(0).value().GetOrdinal(), 8);
+		EXPECT_EQ(blocks.GetEnd(1).value().GetOrdinal(), 6);
+		EXPECT_EQ(blocks.GetNextBranch(1).value().GetOrdinal(), 3);
+		EXPECT_EQ(blocks.GetNextBranch(3).value().GetOrdinal(), 5);
+		EXPECT_EQ(blocks.GetNextBranch(5).value().GetOrdinal(), 6);
+		EXPECT_EQ(blocks.GetOpener(6).value().GetOrdinal(), 1);
+		EXPECT_EQ(blocks.GetOpener(8).value().GetOrdinal(), 0);
+		EXPECT_FALSE(blocks.GetEnd(2).has_value());
+	}
+
+	TEST(TestBlockTable, TestBlockTableUnbalanced) {
+		BaseProgram prog{ "while X not 0 do;decr X;" };
+		BlockTable blocks{ &prog };
+
+		EXPECT_FALSE(blocks.GetEnd(0).has_value());
+	}
+
+	TEST(TestBlockTable, TestBlockTableDeclarations) {
+		BaseProgram prog{ "while X not 0 do;decr X;while Y not 0 do;init Z;decr Y;end;end;if X is 0 then;incr X;else;set W 1;end;" };
+		BlockTable blocks{ &prog };
+
+		// Declarations inside the inner loop do not count against the outer one
+		EXPECT_FALSE(blocks.DeclaresVariables(0));
+		EXPECT_TRUE(blocks.DeclaresVariables(2));
+
+		// Each branch of an if is judged on its own
+		EXPECT_FALSE(blocks.DeclaresVariables(7));
+		EXPECT_TRUE(blocks.DeclaresVariables(9));
+	}
+}
@@ -0,0 +1,53 @@
+#include "pch.h"
+#include "../SpaceCadetsWeek2/scan.hpp"
+#include <random>
+
+namespace barebones_tests {
+	using namespace bbones;
+
+	std::string RandomText(size_t size, std::mt19937& rng)
+	{
+		static constexpr std::string_view alphabet{ "ab ;\n\t\r;;" };
+		std::uniform_int_distribution<size_t> pick{ 0, alphabet.size() - 1 };
+		std::string result(size, ' ');
+		for (auto& c : result)
+			c = alphabet[pick(rng)];
+		return result;
+	}
+
+	TEST(ScanTests, ScalarFindsEveryOccurrence) {
+		std::vector<size_t> offsets{};
+		FindAll("a;bb;;c;", ';', offsets, ScanKernel::Scalar);
+		ASSERT_EQ(offsets, (std::vector<size_t>{ 1, 4, 5, 7 }));
+
+		offsets.clear();
+		FindAll("", ';', offsets, ScanKernel::Scalar);
+		ASSERT_TRUE(offsets.empty());
+	}
+
+	TEST(ScanTests, KernelsMatchScalar) {
+		ASSERT_TRUE(IsSupported(GetBestScanKernel()));
+
+		std::mt19937 rng{ 24 };
+		auto text = RandomText(4096, rng);
+		for (auto kernel : { ScanKernel::Sse2, ScanKernel::Avx2 })
+		{
+			if (!IsSupported(kernel))
+				continue;
+
+			// Every alignment and every length of tail left after the last full vector
+			for (size_t start = 0; start < 64; start++)
+			{
+				for (size_t size : { 0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1000 })
+				{
+					auto view = std::string_view{ text }.substr(start, size);
+					std::vector<size_t> expected{};
+					std::vector<size_t> actual{};
+					FindAll(view, ';', expected, ScanKernel::Scalar);
+					FindAll(view, ';', actual, kernel);
+					ASSERT_EQ(actual, expected) << GetScanKernelName(kernel) << " from " << start << " for " << size;
+				}
+			}
+		}
+	}
+}
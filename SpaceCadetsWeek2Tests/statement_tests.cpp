@@ -2,6 +2,7 @@
 #include "../SpaceCadetsWeek2/runtime.hpp"
 #include "../SpaceCadetsWeek2/lang.hpp"
 #include "../SpaceCadetsWeek2/lang.cpp"
+#include "test_programs.hpp"
 #include <memory>
 
 namespace barebones_tests {
@@ -236,6 +237,33 @@ namespace barebones_tests {
 		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("X").value()->GetValue(), 0);
 	}
 
+	TEST(StatementTests, WhileCompareVariablesTest) {
+		/*
+		init I;
+		init N;
+		init C;
+		set N 7;
+		while I < N do;
+			incr I;
+			if I is N do;
+				incr C;
+			elif C > I do;
+				clear C;
+			end;
+		end;
+		*/
+		BaseProgram* prog = new BaseProgram{"init I;\ninit N;\ninit C;\nset N 7;\nwhile I < N do;\nincr I;\nif I is N do;\nincr C;\nelif C > I do;\nclear C;\nend;\nend;"};
+		auto parser = CreateParser();
+		parser.AddMapping("set", new bbones::SetStatement{});
+		parser.AddMapping("if", new bbones::IfStatement{});
+		parser.AddMapping("elif", new bbones::NoopStatement{});
+
+		BareBones bbones = BareBones::Create(parser, prog);
+		bbones.Execute();
+		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("I").value()->GetValue(), 7);
+		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("C").value()->GetValue(), 1);
+	}
+
 	TEST(StatementTests, IfTest) {
 		/*
 		init X;	
@@ -313,4 +341,187 @@ namespace barebones_tests {
 		ASSERT_TRUE(bbones.GetExecutionState().GetScope()->GetVariable("X").has_value());
 		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("X").value()->GetValue(), 1);
 	}
+
+	TEST(StatementTests, NestedBlockTest) {
+		/*
+		init X;
+		init Y;
+		init Z;
+		clear X;
+		while X not 3 do;
+			if X is 1 do;
+				incr Y;
+			else do;
+				incr Z;
+			end;
+			incr X;
+		end;
+		*/
+		BaseProgram* prog = new BaseProgram{"init X;\ninit Y;\ninit Z;\nclear X;\nwhile X not 3 do;\nif X is 1 do;\nincr Y;\nelse do;\nincr Z;\nend;\nincr X;\nend;"};
+		auto parser = CreateParser();
+		parser.AddMapping("if", new bbones::IfStatement{});
+		parser.AddMapping("else", new bbones::NoopStatement{});
+
+		BareBones bbones = BareBones::Create(parser, prog);
+		bbones.Execute();
+		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("Y").value()->GetValue(), 1);
+		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("Z").value()->GetValue(), 2);
+		ASSERT_EQ(bbones.GetExecutionState().GetControlDepth(), 0);
+	}
+
+	TEST(StatementTests, BlockBodyScopesTest) {
+		// The first loop and its branch declare nothing, so they run in the
+		// enclosing scope. The second loop declares, so each iteration starts
+		// with a fresh scope that is gone once the loop is left.
+		std::string source{
+			"set total 0;\n"
+			"set i 3;\n"
+			"while i not 0 do;\n"
+			"    incr total;\n"
+			"    if i is 2 do;\n"
+			"        add total i into total;\n"
+			"    end;\n"
+			"    decr i;\n"
+			"end;\n"
+			"print total;\n"
+			"print i;\n"
+			"set j 2;\n"
+			"while j not 0 do;\n"
+			"    init fresh;\n"
+			"    incr fresh;\n"
+			"    print fresh;\n"
+			"    if j is 1 do;\n"
+			"        init inner;\n"
+			"        copy total to inner;\n"
+			"        print inner;\n"
+			"    end;\n"
+			"    decr j;\n"
+			"end;\n"
+		};
+		ASSERT_EQ(RunInterpreter(source), "total = 5\ni = 0\nfresh = 1\nfresh = 1\ninner = 5\n");
+		ASSERT_THROW(RunInterpreter(source + "print fresh;"), std::runtime_error);
+		ASSERT_THROW(RunInterpreter(source + "print inner;"), std::runtime_error);
+	}
+
+	TEST(StatementTests, ConditionFollowsFrameTest) {
+		// The same tests run in a frame for every call, each with its own seen and n
+		std::string source{
+			"function count ( n ) do;\n"
+			"    init seen;\n"
+			"    while seen < n do;\n"
+			"        incr seen;\n"
+			"    end;\n"
+			"    print seen;\n"
+			"    if seen > 1 do;\n"
+			"        decr seen;\n"
+			"        count seen;\n"
+			"        print seen;\n"
+			"    end;\n"
+			"end;\n"
+			"set x 3;\n"
+			"count x;\n"
+		};
+		ASSERT_EQ(RunInterpreter(source), "seen = 3\nseen = 2\nseen = 1\nseen = 1\nseen = 2\n");
+	}
+
+	TEST(StatementTests, UnmatchedEndTest) {
+		BaseProgram* prog = new BaseProgram{"init X;\nend;"};
+		BareBones bbones = BareBones::Create(CreateParser(), prog);
+
+		ASSERT_THROW(bbones.Execute(), EndStatementException);
+	}
+
+	TEST(StatementTests, FunctionCallTest) {
+		// Arguments are copies, and the body sees none of the caller's variables
+		BaseProgram* prog = new BaseProgram{"function f ( A ) do;\nincr A;\ninit X;\nend;\ninit X;\nincr X;\nf X;\nf X;"};
+		auto parser = CreateParser();
+		parser.AddMapping("function", new bbones::FunctionDefinitionStatement{});
+
+		BareBones bbones = BareBones::Create(parser, prog);
+		bbones.Execute();
+		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("X").value()->GetValue(), 1);
+		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("A").has_value(), false);
+		ASSERT_EQ(bbones.GetExecutionState().GetControlDepth(), 0);
+	}
+
+	TEST(StatementTests, DeepRecursionTest) {
+		// Far deeper than the host stack would allow if calls recursed on it
+		BaseProgram* prog = new BaseProgram{"function f ( N ) do;\nif N not 0 do;\ndecr N;\nf N;\nincr N;\nend;\nend;\nset Depth 200000;\nf Depth;\nincr Depth;"};
+		auto parser = CreateParser();
+		parser.AddMapping("if", new bbones::IfStatement{});
+		parser.AddMapping("set", new bbones::SetStatement{});
+		parser.AddMapping("function", new bbones::FunctionDefinitionStatement{});
+
+		// Every call still has work to do once the next one returns
+		BareBones bbones = BareBones::Create(parser, prog);
+		size_t max_depth{};
+		while (bbones.Step())
+			max_depth = std::max(max_depth, bbones.GetExecutionState().GetControlDepth());
+		ASSERT_EQ(max_depth, 2 * 200000 + 1);
+		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("Depth").value()->GetValue(), 200001);
+		ASSERT_EQ(bbones.GetExecutionState().GetControlDepth(), 0);
+	}
+
+	TEST(StatementTests, TailCallTest) {
+		BaseProgram* prog = new BaseProgram{"function f ( N ) do;\nif N not 0 do;\ndecr N;\nf N;\nend;\nend;\nset Depth 1000000;\nf Depth;\nincr Depth;"};
+		auto parser = CreateParser();
+		parser.AddMapping("if", new bbones::IfStatement{});
+		parser.AddMapping("set", new bbones::SetStatement{});
+		parser.AddMapping("function", new bbones::FunctionDefinitionStatement{});
+
+		// Each call replaces its caller, which had nothing left to do
+		BareBones bbones = BareBones::Create(parser, prog);
+		size_t max_depth{};
+		while (bbones.Step())
+			max_depth = std::max(max_depth, bbones.GetExecutionState().GetControlDepth());
+		ASSERT_EQ(max_depth, 2);
+		ASSERT_EQ(bbones.GetExecutionState().GetScope()->GetVariable("Depth").value()->GetValue(), 1000001);
+	}
+
+	TEST(StatementTests, MemoizationTest) {
+		// Exponentially many calls without memoization, but only a few distinct arguments
+		BaseProgram* prog = new BaseProgram{"function f ( N ) do;\nif N > 1 do;\ndecr N;\nf N;\ndecr N;\nf N;\nend;\nend;\nset Depth 40;\nf Depth;"};
+		auto parser = CreateParser();
+		parser.AddMapping("if", new bbones::IfStatement{});
+		parser.AddMapping("set", new bbones::SetStatement{});
+		parser.AddMapping("function", new bbones::FunctionDefinitionStatement{});
+
+		BareBones bbones = BareBones::Create(parser, prog);
+		bbones.Execute();
+		auto* f = dynamic_cast<FunctionCallStatement*>(bbones.GetParser().GetStatementFor("f").value());
+		ASSERT_EQ(f->GetMemoStats().misses, 41);
+		ASSERT_EQ(f->GetMemoStats().hits, 38);
+		ASSERT_EQ(bbones.GetExecutionState().GetControlDepth(), 0);
+	}
+
+	TEST(StatementTests, MemoizationOffTest) {
+		BaseProgram* prog = new BaseProgram{"function f ( N ) do;\nif N > 1 do;\ndecr N;\nf N;\ndecr N;\nf N;\nend;\nend;\nset Depth 10;\nf Depth;"};
+		auto parser = CreateParser();
+		parser.AddMapping("if", new bbones::IfStatement{});
+		parser.AddMapping("set", new bbones::SetStatement{});
+		parser.AddMapping("function", new bbones::FunctionDefinitionStatement{});
+
+		BareBones bbones = BareBones::Create(parser, prog);
+		bbones.SetMemoizing(false);
+		bbones.Execute();
+		auto* f = dynamic_cast<FunctionCallStatement*>(bbones.GetParser().GetStatementFor("f").value());
+		ASSERT_EQ(f->GetMemoStats().misses, 0);
+		ASSERT_EQ(f->GetMemoStats().hits, 0);
+	}
+
+	TEST(StatementTests, ImpureFunctionTest) {
+		// Printing, or calling something that prints, is seen every time
+		BaseProgram* prog = new BaseProgram{"function show ( N ) do;\nprint N;\nend;\nfunction outer ( N ) do;\nshow N;\nend;\nset X 3;\nouter X;\nouter X;"};
+		auto parser = CreateParser();
+		parser.AddMapping("set", new bbones::SetStatement{});
+		parser.AddMapping("print", new bbones::PrintStatement{});
+		parser.AddMapping("function", new bbones::FunctionDefinitionStatement{});
+
+		BareBones bbones = BareBones::Create(parser, prog);
+		testing::internal::CaptureStdout();
+		bbones.Execute();
+		ASSERT_EQ(testing::internal::GetCapturedStdout(), "N = 3\nN = 3\n");
+		auto* outer = dynamic_cast<FunctionCallStatement*>(bbones.GetParser().GetStatementFor("outer").value());
+		ASSERT_EQ(outer->GetMemoStats().misses, 0);
+	}
 }
@@ -0,0 +1,135 @@
+#pragma once
+#include "pch.h"
+#include "../SpaceCadetsWeek2/lang.hpp"
+#include "../SpaceCadetsWeek2/analyzer.hpp"
+#include "../SpaceCadetsWeek2/compiler.hpp"
+#include "../SpaceCadetsWeek2/optimizer.hpp"
+#include "../SpaceCadetsWeek2/vm.hpp"
+#include "../SpaceCadetsWeek2/superinstructions.hpp"
+
+namespace barebones_tests {
+	// The full statement set, as registered by the interpreter's main
+	inline bbones::Parser CreateLanguageParser()
+	{
+		return bbones::Parser::Builder()
+			.AddMapping("init", new bbones::InitStatement{})
+			.AddMapping("incr", new bbones::IncrementStatement{})
+			.AddMapping("decr", new bbones::DecrementStatement{})
+			.AddMapping("clear", new bbones::ClearStatement{})
+			.AddMapping("while", new bbones::WhileStatement{})
+			.AddMapping("copy", new bbones::CopyStatement{})
+			.AddMapping("end", new bbones::EndStatement{})
+			.AddMapping("if", new bbones::IfStatement{})
+			.AddMapping("elif", new bbones::NoopStatement{})
+			.AddMapping("else", new bbones::NoopStatement{})
+			.AddMapping("print", new bbones::PrintStatement{})
+			.AddMapping("add", new bbones::AddStatement{})
+			.AddMapping("sub", new bbones::SubStatement{})
+			.AddMapping("mul", new bbones::MulStatement{})
+			.AddMapping("div", new bbones::DivStatement{})
+			.AddMapping("mod", new bbones::ModStatement{})
+			.AddMapping("set", new bbones::SetStatement{})
+			.AddMapping("function", new bbones::FunctionDefinitionStatement{})
+			.Finish();
+	}
+
+	// Run something that prints and return what it printed, even if it throws
+	template <typename F>
+	std::string CaptureStdout(F&& run)
+	{
+		testing::internal::CaptureStdout();
+		try {
+			run();
+		}
+		catch (...) {
+			testing::internal::GetCapturedStdout();
+			throw;
+		}
+		return testing::internal::GetCapturedStdout();
+	}
+
+	// Run a program on the tree-walker as main does and return what it printed
+	inline std::string RunInterpreter(const std::string& source)
+	{
+		bbones::BaseProgram program{ source };
+		auto analysis = bbones::Analyzer{ CreateLanguageParser() }.Analyze(&program);
+		auto machine = bbones::BareBones::Create(CreateLanguageParser(), &program, analysis.accesses);
+		return CaptureStdout([&]() { machine.Execute(); });
+	}
+
+	// Compile a program as main does, run it on the VM and return what it printed
+	inline std::string RunVirtualMachine(const std::string& source)
+	{
+		bbones::BaseProgram program{ source };
+		auto code = bbones::Compiler{ CreateLanguageParser() }.Compile(&program);
+		bbones::FuseSuperinstructions(code);
+		bbones::VirtualMachine vm{ std::move(code) };
+		return CaptureStdout([&]() { vm.Execute(); });
+	}
+
+	// As RunVirtualMachine, with the code optimized first as main does
+	inline std::string RunVirtualMachine(const std::string& source, const bbones::OptimizerOptions& options)
+	{
+		bbones::BaseProgram program{ source };
+		auto code = bbones::Compiler{ CreateLanguageParser() }.Compile(&program);
+		bbones::Optimize(code, options);
+		bbones::FuseSuperinstructions(code);
+		bbones::VirtualMachine vm{ std::move(code) };
+		return CaptureStdout([&]() { vm.Execute(); });
+	}
+
+	// As RunVirtualMachine, but with every loop and function compiled to machine code on first entry
+	inline std::string RunJit(const std::string& source)
+	{
+		bbones::BaseProgram program{ source };
+		auto code = bbones::Compiler{ CreateLanguageParser() }.Compile(&program);
+		bbones::FuseSuperinstructions(code);
+		bbones::VirtualMachine vm{ std::move(code) };
+		vm.SetJitThreshold(1);
+		return CaptureStdout([&]() { vm.Execute(); });
+	}
+
+	inline const std::string fib_program{
+		"function print_fib ( n ) do;\n"
+		"    set l 0;\n"
+		"    set r 1;\n"
+		"    set fib_result 1;\n"
+		"    if n <= 1 do;\n"
+		"        print l;\n"
+		"    elif n <= 3 do;\n"
+		"        print r;\n"
+		"    else do;\n"
+		"        while n > 2 do;\n"
+		"            add l r into fib_result;\n"
+		"            copy r to l;\n"
+		"            copy fib_result to r;\n"
+		"            decr n;\n"
+		"        end;\n"
+		"        print fib_result;\n"
+		"    end;\n"
+		"end;\n"
+		"set n 1;\n"
+		"print_fib n;\n"
+		"set n 3;\n"
+		"print_fib n;\n"
+		"set n 20;\n"
+		"print_fib n;\n"
+	};
+
+	inline const std::string pow_program{
+		"function pow ( base exp ) do;\n"
+		"    set out 1;\n"
+		"    while exp not 0 do;\n"
+		"        mul out base into out;\n"
+		"        decr exp;\n"
+		"    end;\n"
+		"    print out;\n"
+		"end;\n"
+		"set base 5;\n"
+		"set exp 2;\n"
+		"pow base exp;\n"
+		"set base 3;\n"
+		"set exp 7;\n"
+		"pow base exp;\n"
+	};
+}
@@ -0,0 +1,154 @@
+#include "pch.h"
+#include "test_programs.hpp"
+#include "../SpaceCadetsWeek2/transpiler.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace barebones_tests {
+	using namespace bbones;
+
+	std::string Transpile(const std::string& source)
+	{
+		BaseProgram program{ source };
+		return Transpiler{ CreateLanguageParser() }.Transpile(&program);
+	}
+
+	int RunCommand(const std::string& command)
+	{
+#ifdef _WIN32
+		// cmd strips the outer quotes of a command that starts with one
+		return std::system(("\"" + command + "\"").c_str());
+#else
+		return std::system(command.c_str());
+#endif
+	}
+
+	// Builds a C++ file with cl or c++, whichever matches the compiler of the tests
+	bool CompileCpp(const std::filesystem::path& source, const std::filesystem::path& binary)
+	{
+#ifdef _MSC_VER
+		auto object = std::filesystem::path{ binary }.replace_extension(".obj");
+		return RunCommand("cl /nologo /std:c++20 /EHsc /O2 \"" + source.string() + "\" /Fe\"" + binary.string() + "\" /Fo\"" + object.string() + "\" > NUL") == 0;
+#else
+		return RunCommand("c++ -std=c++20 -O2 \"" + source.string() + "\" -o \"" + binary.string() + "\"") == 0;
+#endif
+	}
+
+	bool HasCompiler()
+	{
+		static const bool found = []() {
+			auto dir = std::filesystem::temp_directory_path();
+			std::ofstream{ dir / "bbones_probe.cpp" } << "int main() { return 0; }\n";
+			return CompileCpp(dir / "bbones_probe.cpp", dir / "bbones_probe.exe");
+		}();
+		return found;
+	}
+
+	// Build the generated code for a program, run it and return what it printed
+	std::string RunTranspiled(const std::string& source, const std::string& name)
+	{
+		auto dir = std::filesystem::temp_directory_path();
+		auto code = dir / ("bbones_" + name + ".cpp");
+		auto binary = dir / ("bbones_" + name + ".exe");
+		auto output = dir / ("bbones_" + name + ".txt");
+		std::ofstream{ code } << Transpile(source);
+		if (!CompileCpp(code, binary))
+			throw std::runtime_error{ "generated code for " + name + " does not compile" };
+		if (RunCommand("\"" + binary.string() + "\" > \"" + output.string() + "\"") != 0)
+			throw std::runtime_error{ "generated program " + name + " failed" };
+
+		std::stringstream printed{};
+		printed << std::ifstream{ output }.rdbuf();
+		return printed.str();
+	}
+
+	testing::AssertionResult Contains(const std::string& source, const std::string& expected)
+	{
+		if (source.find(expected) != std::string::npos)
+			return testing::AssertionSuccess();
+		return testing::AssertionFailure() << "generated code:\n" << source << "\ndoes not contain:\n" << expected;
+	}
+
+	TEST(TranspilerTests, FunctionsAndLoopsAreNative) {
+		auto result = Transpile(pow_program);
+		EXPECT_TRUE(Contains(result, "\tvoid f_pow(int32_t v_base, int32_t v_exp);\n"));
+		EXPECT_TRUE(Contains(result, "\t\twhile (v_exp != 0) {\n\t\t\tv_out = Mul(v_out, v_base);\n\t\t\tv_exp = Sub(v_exp, 1);\n\t\t}\n"));
+		EXPECT_TRUE(Contains(result, "\t\tint32_t v_base = 5;\n"));
+		EXPECT_TRUE(Contains(result, "\t\tv_base = 3;\n"));
+		EXPECT_TRUE(Contains(result, "\t\tf_pow(v_base, v_exp);\n"));
+	}
+
+	TEST(TranspilerTests, GeneratedProgramsMatchInterpreter) {
+		if (!HasCompiler())
+			GTEST_SKIP() << "no C++ compiler on the path to build the generated code with";
+
+		std::string branches{
+			"set total 0;\n"
+			"set i 4;\n"
+			"while i not 0 do;\n"
+			"    set j 3;\n"
+			"    while j > 0 do;\n"
+			"        if j is 2 do;\n"
+			"            add total i into total;\n"
+			"        elif j is 1 do;\n"
+			"            incr total;\n"
+			"        else do;\n"
+			"            decr total;\n"
+			"        end;\n"
+			"        decr j;\n"
+			"    end;\n"
+			"    decr i;\n"
+			"end;\n"
+			"print total;\n"
+			"print i;\n"
+		};
+		EXPECT_EQ(RunTranspiled(fib_program, "fib"), RunInterpreter(fib_program));
+		EXPECT_EQ(RunTranspiled(pow_program, "pow"), RunInterpreter(pow_program));
+		EXPECT_EQ(RunTranspiled(branches, "branches"), RunInterpreter(branches));
+	}
+
+	TEST(TranspilerTests, BranchesBecomeIfChains) {
+		auto result = Transpile("set x 1;if x is 0 do;print x;elif x < -2147483648 do;else;clear x;else;incr x;end;");
+		EXPECT_TRUE(Contains(result, 
+			"\t\tif (v_x == 0) {\n"
+			"\t\t\tPrint(\"x\", v_x);\n"
+			"\t\t} else if (v_x < INT32_MIN) {\n"
+			"\t\t} else {\n"
+			"\t\t\tv_x = 0;\n"
+			"\t\t}\n"
+			"\t\tif (false) {\n"
+			"\t\t\tv_x = Add(v_x, 1);\n"
+			"\t\t}\n"));
+	}
+
+	TEST(TranspilerTests, VariablesCanBeCompared) {
+		auto result = Transpile("set i 0;set n 3;while i < n do;incr i;end;if i is m do;end;");
+		EXPECT_TRUE(Contains(result, "\t\twhile (v_i < v_n) {\n"));
+		EXPECT_TRUE(Contains(result, "\t\tif ((Fault(\"Error: tried to access variable \\\"m\\\" when it does not exist!\"), true)) {\n"));
+	}
+
+	TEST(TranspilerTests, ErrorsAreRaisedWhereReached) {
+		auto result = Transpile("set x 1;while y not 0 do;print z;end;set a-b 2;end;");
+		EXPECT_TRUE(Contains(result, "\t\twhile ((Fault(\"Error: tried to access variable \\\"y\\\" when it does not exist!\"), true)) {\n"));
+		EXPECT_TRUE(Contains(result, "\t\t\tFault(\"Error: tried to access variable \\\"z\\\" when it does not exist!\");\n"));
+		EXPECT_TRUE(Contains(result, "\t\tint32_t vx612d62 = 2;\n"));
+		EXPECT_TRUE(Contains(result, "\t\tFault(\"Unexpected end statement encountered during execution.\");\n"));
+	}
+
+	TEST(TranspilerTests, UnclosedBlocksFault) {
+		// Running into the end of the program faults from inside the loop, after it and at the definition
+		auto result = Transpile("function f ( a ) do;while a not 0 do;decr a;");
+		EXPECT_TRUE(Contains(result, 
+			"\tvoid f_f(int32_t v_a)\n"
+			"\t{\n"
+			"\t\twhile (v_a != 0) {\n"
+			"\t\t\tv_a = Sub(v_a, 1);\n"
+			"\t\t\tFault(\"Error: missing end statement.\");\n"
+			"\t\t}\n"
+			"\t\tFault(\"Error: missing end statement.\");\n"
+			"\t}\n"));
+		EXPECT_TRUE(Contains(result, "\tvoid Run()\n\t{\n\t\tFault(\"Error: missing end statement.\");\n\t}\n"));
+	}
+}
@@ -0,0 +1,216 @@
+#include "pch.h"
+#include "test_programs.hpp"
+
+namespace barebones_tests {
+	using namespace bbones;
+
+	TEST(VirtualMachineTests, FibMatchesInterpreter) {
+		auto expected = RunInterpreter(fib_program);
+		ASSERT_EQ(expected, "l = 0\nr = 1\nfib_result = 4181\n");
+		ASSERT_EQ(RunVirtualMachine(fib_program), expected);
+	}
+
+	TEST(VirtualMachineTests, PowMatchesInterpreter) {
+		auto expected = RunInterpreter(pow_program);
+		ASSERT_EQ(expected, "out = 25\nout = 2187\n");
+		ASSERT_EQ(RunVirtualMachine(pow_program), expected);
+	}
+
+	TEST(VirtualMachineTests, NestedLoopsAndBranches) {
+		std::string source{
+			"set total 0;\n"
+			"set i 4;\n"
+			"while i not 0 do;\n"
+			"    set j 3;\n"
+			"    while j > 0 do;\n"
+			"        if j is 2 do;\n"
+			"            add total i into total;\n"
+			"        elif j is 1 do;\n"
+			"            incr total;\n"
+			"        else do;\n"
+			"            decr total;\n"
+			"        end;\n"
+			"        decr j;\n"
+			"    end;\n"
+			"    decr i;\n"
+			"end;\n"
+			"print total;\n"
+			"print i;\n"
+		};
+		auto expected = RunInterpreter(source);
+		ASSERT_EQ(expected, "total = 10\ni = 0\n");
+		ASSERT_EQ(RunVirtualMachine(source), expected);
+	}
+
+	TEST(VirtualMachineTests, VariableComparisonsMatchInterpreter) {
+		std::string source{
+			"set i 0;\n"
+			"set n 5;\n"
+			"set total 0;\n"
+			"while i < n do;\n"
+			"    set j 0;\n"
+			"    while j <= i do;\n"
+			"        if j is i do;\n"
+			"            add total j into total;\n"
+			"        elif j >= n do;\n"
+			"            decr total;\n"
+			"        end;\n"
+			"        incr j;\n"
+			"    end;\n"
+			"    incr i;\n"
+			"end;\n"
+			"print total;\n"
+			"while total > missing do;\n"
+			"end;\n"
+		};
+		ASSERT_THROW(RunInterpreter(source), std::runtime_error);
+		ASSERT_THROW(RunVirtualMachine(source), std::runtime_error);
+
+		source.resize(source.find("while total"));
+		auto expected = RunInterpreter(source);
+		ASSERT_EQ(expected, "total = 10\n");
+		ASSERT_EQ(RunVirtualMachine(source), expected);
+	}
+
+	TEST(VirtualMachineTests, RecursionMatchesInterpreter) {
+		std::string source{
+			"function countdown ( n ) do;\n"
+			"    print n;\n"
+			"    if n > 0 do;\n"
+			"        decr n;\n"
+			"        countdown n;\n"
+			"    end;\n"
+			"end;\n"
+			"set n 3;\n"
+			"countdown n;\n"
+		};
+		auto expected = RunInterpreter(source);
+		ASSERT_EQ(expected, "n = 3\nn = 2\nn = 1\nn = 0\n");
+		ASSERT_EQ(RunVirtualMachine(source), expected);
+	}
+
+	TEST(VirtualMachineTests, BlockScopesAreDiscarded) {
+		// y only lives for the duration of the branch
+		std::string source{ "set x 1;\nif x is 1 do;\nset y 2;\nprint y;\nend;\nprint y;" };
+		BaseProgram program{ source };
+		VirtualMachine vm{ Compiler{ CreateLanguageParser() }.Compile(&program) };
+
+		testing::internal::CaptureStdout();
+		EXPECT_THROW(vm.Execute(), std::runtime_error);
+		ASSERT_EQ(testing::internal::GetCapturedStdout(), "y = 2\n");
+	}
+
+	TEST(VirtualMachineTests, UnrecognisedStatementFaultsWhenReached) {
+		std::string source{ "set x 0;\nif x is 1 do;\nfrobnicate x;\nend;\nprint x;\nfrobnicate x;" };
+		BaseProgram program{ source };
+		VirtualMachine vm{ Compiler{ CreateLanguageParser() }.Compile(&program) };
+
+		testing::internal::CaptureStdout();
+		EXPECT_THROW(vm.Execute(), std::runtime_error);
+		ASSERT_EQ(testing::internal::GetCapturedStdout(), "x = 0\n");
+	}
+
+	TEST(VirtualMachineTests, SlotsResolveGlobals) {
+		std::string source{ "set x 7;\ninit y;\ncopy x to y;\nincr y;\nwhile x not 0 do;\nset tmp 1;\nsub x tmp into x;\nend;" };
+		BaseProgram program{ source };
+		VirtualMachine vm{ Compiler{ CreateLanguageParser() }.Compile(&program) };
+		vm.Execute();
+
+		ASSERT_EQ(vm.GetGlobal("x"), 0);
+		ASSERT_EQ(vm.GetGlobal("y"), 8);
+		ASSERT_FALSE(vm.GetGlobal("tmp").has_value());
+	}
+
+	TEST(VirtualMachineTests, UndefinedVariableFaultsAtSameStatement) {
+		// The access in the untaken branch must not fault, the one after the print must
+		std::string source{ "set x 0;\nif x is 1 do;\nincr missing;\nend;\nprint x;\nadd x missing into x;\nprint x;" };
+		BaseProgram program{ source };
+		VirtualMachine vm{ Compiler{ CreateLanguageParser() }.Compile(&program) };
+
+		testing::internal::CaptureStdout();
+		try {
+			vm.Execute();
+			FAIL() << "expected the add to fault";
+		}
+		catch (const std::runtime_error& e) {
+			ASSERT_STREQ(e.what(), "Error: tried to access variable \"missing\" when it does not exist!");
+		}
+		ASSERT_EQ(testing::internal::GetCapturedStdout(), "x = 0\n");
+	}
+
+	TEST(VirtualMachineTests, LoopBodyVariablesAreFreshEachIteration) {
+		// init inside the body would throw on the second iteration if the scope leaked
+		std::string source{ "set i 3;\nwhile i not 0 do;\ninit t;\nincr t;\nprint t;\ndecr i;\nend;" };
+		auto expected = RunInterpreter(source);
+		ASSERT_EQ(expected, "t = 1\nt = 1\nt = 1\n");
+		ASSERT_EQ(RunVirtualMachine(source), expected);
+	}
+
+	TEST(VirtualMachineTests, ArithmeticWrapsLikeInterpreter) {
+		std::string source{
+			"set big 2147483647;\n"
+			"incr big;\n"
+			"print big;\n"
+			"decr big;\n"
+			"print big;\n"
+			"init sum;\n"
+			"init diff;\n"
+			"init product;\n"
+			"add big big into sum;\n"
+			"sub sum big into diff;\n"
+			"set half 65536;\n"
+			"mul half half into product;\n"
+			"print sum;\n"
+			"print diff;\n"
+			"print product;\n"
+		};
+		auto expected = RunInterpreter(source);
+		ASSERT_EQ(expected, "big = -2147483648\nbig = 2147483647\nsum = -2\ndiff = 2147483647\nproduct = 0\n");
+		ASSERT_EQ(RunVirtualMachine(source), expected);
+		ASSERT_EQ(RunJit(source), expected);
+	}
+
+	TEST(VirtualMachineTests, StatementsSpanLines) {
+		std::string source{
+			"set a 2;\n"
+			"set b 3;\n"
+			"init c;\n"
+			"add a b\n"
+			"    into c;\n"
+			"print c;\n"
+			"while\tc\r\n"
+			"\tnot 0 do;\r\n"
+			"\tdecr\r\n\t\tc;\r\n"
+			"end;\r\n"
+			"print\nc;\n"
+		};
+		auto expected = RunInterpreter(source);
+		ASSERT_EQ(expected, "c = 5\nc = 0\n");
+		ASSERT_EQ(RunVirtualMachine(source), expected);
+		ASSERT_EQ(RunJit(source), expected);
+	}
+
+	TEST(VirtualMachineTests, FibLoopIsFused) {
+		BaseProgram program{ fib_program };
+		auto code = Compiler{ CreateLanguageParser() }.Compile(&program);
+		FuseSuperinstructions(code);
+
+		auto count = [&](OpCode op) { return std::count_if(code.code.begin(), code.code.end(), [&](const auto& insn) { return insn.op == op; }); };
+		ASSERT_EQ(count(OpCode::AddRotate), 1);
+		ASSERT_EQ(count(OpCode::StepEndWhile), 1);
+	}
+
+	TEST(VirtualMachineTests, ProfileCountsSequences) {
+		BaseProgram program{ "set i 5;while i not 0 do;print i;decr i;end;" };
+		VirtualMachine vm{ Compiler{ CreateLanguageParser() }.Compile(&program) };
+
+		testing::internal::CaptureStdout();
+		vm.Profile();
+		testing::internal::GetCapturedStdout();
+
+		// The back edge of the loop runs once per iteration
+		auto hot = vm.GetHotSequences(1);
+		ASSERT_EQ(hot.size(), 1);
+		ASSERT_EQ(hot[0].count, 5);
+	}
+}